@@ -0,0 +1,30 @@
+# Writes a C++ source holding files as constant data, see include/EmbeddedShaders.hpp
+# cmake -DOUTPUT=<source> -DNAMES=<name|...> -DFILES=<path|...> -P EmbedFiles.cmake
+
+string(REPLACE "|" ";" NAMES "${NAMES}")
+string(REPLACE "|" ";" FILES "${FILES}")
+set(ARRAYS "")
+set(ENTRIES "")
+list(LENGTH FILES FILE_COUNT)
+math(EXPR LAST_FILE "${FILE_COUNT} - 1")
+foreach(INDEX RANGE ${LAST_FILE})
+  list(GET FILES ${INDEX} FILE_PATH)
+  list(GET NAMES ${INDEX} FILE_NAME)
+  file(READ "${FILE_PATH}" HEX_CONTENT HEX)
+  string(LENGTH "${HEX_CONTENT}" HEX_LENGTH)
+  math(EXPR FILE_SIZE "${HEX_LENGTH} / 2")
+  string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," BYTES "${HEX_CONTENT}")
+  # 4 byte aligned so SPIR-V can be read as words, and null terminated so GLSL can be passed as a C string
+  set(ARRAYS "${ARRAYS}  alignas(4) unsigned char const file${INDEX}[] = {${BYTES}0x00};\n")
+  set(ENTRIES "${ENTRIES}  {\"${FILE_NAME}\", file${INDEX}, ${FILE_SIZE}},\n")
+endforeach()
+
+file(WRITE "${OUTPUT}.tmp"
+  "// Generated by cmake/EmbedFiles.cmake\n"
+  "#include \"EmbeddedShaders.hpp\"\n\n"
+  "namespace\n{\n${ARRAYS}}\n\n"
+  "shaders::EmbeddedFile const shaders::embeddedFiles[] = {\n${ENTRIES}};\n"
+  "std::size_t const shaders::embeddedFileCount = ${FILE_COUNT};\n")
+# an unchanged source isn't rebuilt
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different "${OUTPUT}.tmp" "${OUTPUT}")
+file(REMOVE "${OUTPUT}.tmp")
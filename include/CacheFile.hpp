@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * Files kept between runs in $XDG_CACHE_HOME/feathers (~/.cache/feathers without it): GL program binaries, the Vulkan pipeline cache.
+ * They only save work, every failure is reported as a miss for the caller to redo that work.
+ */
+namespace cache
+{
+  // Path of name in the cache directory, created as needed. Empty when there's nowhere to cache.
+  std::string getPath(std::string const &name);
+  // The size bytes at the position of input. False when the file is shorter: a corrupt size never gets allocated.
+  bool read(std::istream &input, uint64_t size, std::vector<char> &data);
+  // Replaces the file at path by the parts one after the other.
+  // It's written to a file of its own then renamed, a concurrent start never reads or renames half a file.
+  bool write(std::string const &path, std::initializer_list<std::string_view> parts);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+/*
+ * Shaders built into the binary by CMake (see cmake/EmbedFiles.cmake): the GLSL sources of shaders/ for GL,
+ * and the SPIR-V glslangValidator compiled from them for Vulkan, named after the source with a .spirv suffix.
+ */
+namespace shaders
+{
+  struct EmbeddedFile
+  {
+    char const *name;
+    // 4 byte aligned and followed by a null byte
+    unsigned char const *data;
+    std::size_t size;
+  };
+
+  extern EmbeddedFile const embeddedFiles[];
+  extern std::size_t const embeddedFileCount;
+
+  // Contents of shaders/name, or of the SPIR-V it compiles to for name.spirv. Throws std::runtime_error for an unknown name.
+  std::string_view get(std::string_view name);
+}
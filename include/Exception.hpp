@@ -6,3 +6,7 @@
 class ModeSettingError : public std::runtime_error {
   using std::runtime_error::runtime_error;
 };
+
+class HeadlessError : public std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
@@ -1,6 +1,14 @@
 #pragma once
 
 #include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <vector>
 
 #include <magma/DisplaySystem.hpp>
 #include <magma/VulkanHandler.hpp>
@@ -20,58 +28,79 @@
 #include <magma/Sampler.hpp>
 #include <magma/DynamicBuffer.hpp>
 
+#include "EmbeddedShaders.hpp"
+#include "display/PipelineCache.hpp"
+#include "display/PresentLatency.hpp"
 #include "display/SuperCorbeau.hpp"
+#include "pixel/Convert.hpp"
 
 namespace display
 {
   class Display
   {
+  public:
+    // A surface drawn by the compositor pass, the layout of SurfaceInstance in basic.vert (std430)
+    struct SurfaceInstance
+    {
+      // top left, in pixels
+      std::array<float, 2u> position;
+      // in pixels
+      std::array<float, 2u> size;
+      // index returned by addTexture, in the texture array of basic.frag
+      uint32_t texture;
+      uint32_t padding;
+    };
+
+  private:
     struct Renderer
     {
+      // size of the texture array of the descriptor set, MAX_TEXTURES in basic.frag
+      static constexpr uint32_t MAX_TEXTURES = 256;
+      // the instances are written with vkCmdUpdateBuffer, limited to 65536 bytes
+      static constexpr uint32_t MAX_SURFACES = 1024;
+
       struct UserData
       {
 	magma::CommandPool<> commandPool;
 	magma::DescriptorSetLayout<> descriptorSetLayout;
 	magma::PipelineLayout<> pipelineLayout;
+	// every pipeline is created through it, see createPipeline
+	PipelineCache pipelineCache;
 	magma::ShaderModule<> vert;
 	magma::ShaderModule<> frag;
 
-	UserData(magma::Device<claws::no_delete> device, vk::PhysicalDevice, uint32_t selectedQueueFamily)
+	UserData(magma::Device<claws::no_delete> device, vk::PhysicalDevice physicalDevice, uint32_t selectedQueueFamily)
 	  : commandPool(device.createCommandPool({vk::CommandPoolCreateFlagBits::eResetCommandBuffer}, selectedQueueFamily))
+	  // the surfaces, and every texture they index
 	  , descriptorSetLayout(device.createDescriptorSetLayout({
-		vk::DescriptorSetLayoutBinding{0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment, nullptr
-		    }}))
+		vk::DescriptorSetLayoutBinding{0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex, nullptr},
+		  vk::DescriptorSetLayoutBinding{1, vk::DescriptorType::eCombinedImageSampler, MAX_TEXTURES, vk::ShaderStageFlagBits::eFragment, nullptr}
+	      }))
 	  , pipelineLayout(device.createPipelineLayout({}, {descriptorSetLayout}, {}))
+	  , pipelineCache(device, physicalDevice)
 	{
 	  {
-	    std::ifstream vertSource("spirv/basic.vert.spirv");
-	    std::ifstream fragSource("spirv/basic.frag.spirv");
+	    // the SPIR-V is built into the binary, the fragment shader indexes the textures with nonuniformEXT when the device enables it
+	    std::istringstream vertSource(std::string(shaders::get("basic.vert.spirv")));
+	    std::istringstream fragSource(std::string(shaders::get(supportsNonUniformIndexing(physicalDevice) ? "basicNonUniform.frag.spirv" : "basic.frag.spirv")));
 
-	    if (!vertSource || !fragSource)
-	      throw std::runtime_error("Failed to load shaders");
 	    vert = device.createShaderModule(static_cast<std::istream &>(vertSource));
 	    frag = device.createShaderModule(static_cast<std::istream &>(fragSource));
 	  }
 
 	}
-
-	vk::Extent2D getExtent() const noexcept
-	{
-	  return vk::Extent2D{100, 100};
-	}
       };
 
       struct SwapchainUserData
       {
-	magma::CommandBufferGroup<magma::PrimaryCommandBuffer> commandBuffers;
 	magma::RenderPass<> renderPass;
-	magma::Pipeline<> pipeline;
+	GraphicsPipeline pipeline;
 
 	// This functions pipeline creation
 	// the reason I refactored this out is that it's pretty long and verbose
-	magma::Pipeline<> createPipeline(magma::Device<claws::no_delete> device, magma::Swapchain<claws::no_delete> swapchain, UserData const &userData)
+	GraphicsPipeline createPipeline(vk::Extent2D extent, UserData const &userData)
 	{
-	  std::cout << "creating pipeline for swapchain with extent " << swapchain.getExtent().width << ", " << swapchain.getExtent().height << std::endl;
+	  std::cout << "creating pipeline for swapchain with extent " << extent.width << ", " << extent.height << std::endl;
 	  /// --- Specialisation info --- ///
 	  // The width and height are specialized rather than being push constants, because a compositor shoudn't change size often (If ever).
 	  // Both entries have the size of a float
@@ -81,7 +110,7 @@ namespace display
 	      vk::SpecializationMapEntry{1, sizeof(float), sizeof(float)}
 	  };
 	  // These are the actual specialisation values
-	  std::array<float, 2u> dimensions{static_cast<float>(swapchain.getExtent().width), static_cast<float>(swapchain.getExtent().height)};
+	  std::array<float, 2u> dimensions{static_cast<float>(extent.width), static_cast<float>(extent.height)};
 
 	  auto specialzationInfo(magma::StructBuilder<vk::SpecializationInfo>::make(mapEntries, sizeof(float) * 2, dimensions.data()));
 	  /// --- Specialisation info END --- ///
@@ -94,30 +123,22 @@ namespace display
 
 	  // We are rendering triangle strips, and primitives shouldn't restart.
 	  vk::PipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo{{}, vk::PrimitiveTopology::eTriangleStrip, false};
-	  // We have tzo seperate wertex buffers: one for position and one for color
-	  std::array<vk::VertexInputBindingDescription, 2u> vertexInputBindings{
-	    vk::VertexInputBindingDescription{0, 2 * sizeof(float), vk::VertexInputRate::eVertex},
-	      vk::VertexInputBindingDescription{1, 2 * sizeof(float), vk::VertexInputRate::eVertex}
-	  };
-	  // Both vertex buffers contains `vec2`s of floats, which is the format `vk::Format::eR32G32Sfloat`
-	  std::array<vk::VertexInputAttributeDescription, 2u>
-	    vertexInputAttrib{vk::VertexInputAttributeDescription{0, vertexInputBindings[0].binding, vk::Format::eR32G32Sfloat, 0},
-	      vk::VertexInputAttributeDescription{1, vertexInputBindings[1].binding, vk::Format::eR32G32Sfloat, 0}};
-
-	  auto vertexInputStateCreateInfo(magma::StructBuilder<vk::PipelineVertexInputStateCreateInfo, true>::make(vertexInputBindings,
-														   vertexInputAttrib));
+	  // No vertex buffers: the vertex shader makes the quad corners from the vertex index
+	  // and reads the surface from the storage buffer with the instance index
+	  auto vertexInputStateCreateInfo(magma::StructBuilder<vk::PipelineVertexInputStateCreateInfo, true>::make(magma::EmptyList{},
+														   magma::EmptyList{}));
 
 	  // The viewport is st up so that the top left corner is (0, 0) and the bottom right (width, height)
 	  // We don't really care about depth
-	  vk::Viewport viewport(-static_cast<float>(swapchain.getExtent().width),
-				-static_cast<float>(swapchain.getExtent().height), // pos
-				static_cast<float>(swapchain.getExtent().width) * 2.0f,
-				static_cast<float>(swapchain.getExtent().height) * 2.0f, // size
+	  vk::Viewport viewport(-static_cast<float>(extent.width),
+				-static_cast<float>(extent.height), // pos
+				static_cast<float>(extent.width) * 2.0f,
+				static_cast<float>(extent.height) * 2.0f, // size
 				0.0f,
 				1.0); // depth range
 
 	  // Scissors cover all that is within the compositor
-	  vk::Rect2D scissor({0, 0}, swapchain.getExtent());
+	  vk::Rect2D scissor({0, 0}, extent);
 
 	  auto viewportStateCreateInfo(magma::StructBuilder<vk::PipelineViewportStateCreateInfo, true>::make(magma::asListRef(viewport),
 													     magma::asListRef(scissor)));
@@ -170,29 +191,39 @@ namespace display
 		  {0.0f, 0.0f, 0.0f, 0.0f}    // float                                          blendConstants[4]
 	  };
 
-	  magma::GraphicsPipelineConfig pipelineCreateInfo({},
-							   std::move(shaderStageCreateInfos),
-							   vertexInputStateCreateInfo,
-							   inputAssemblyStateCreateInfo,
-							   rasterizationStateCreateInfo,
-							   userData.pipelineLayout,
-							   renderPass,
-							   0);
-
-	  pipelineCreateInfo.addRasteringColorAttachementInfo(viewportStateCreateInfo, multisampleStateCreateInfo, colorBlendStateCreateInfo);
-	  return device.createPipeline(pipelineCreateInfo);
+	  // created with the core entry point, the cache is a parameter of vkCreateGraphicsPipelines
+	  vk::GraphicsPipelineCreateInfo pipelineCreateInfo{
+	    {},
+	      static_cast<uint32_t>(shaderStageCreateInfos.size()),
+		shaderStageCreateInfos.data(),
+		&vertexInputStateCreateInfo,
+		&inputAssemblyStateCreateInfo,
+		nullptr,                       // no tessellation
+		&viewportStateCreateInfo,
+		&rasterizationStateCreateInfo,
+		&multisampleStateCreateInfo,
+		nullptr,                       // no depth nor stencil
+		&colorBlendStateCreateInfo,
+		nullptr,                       // no dynamic state
+		userData.pipelineLayout,
+		renderPass,
+		0                              // subpass
+		};
+	  GraphicsPipeline pipeline(userData.pipelineCache.createGraphicsPipeline(pipelineCreateInfo));
+
+	  // the next start and swapchain recreations find the compiled shaders in the cache
+	  userData.pipelineCache.save();
+	  return pipeline;
 	}
 
-	SwapchainUserData() = default;
-	SwapchainUserData(magma::Device<claws::no_delete> device, magma::Swapchain<claws::no_delete> swapchain, UserData &userData, uint32_t imageCount)
-	  : commandBuffers(userData.commandPool.allocatePrimaryCommandBuffers(imageCount))
-	  , renderPass([&](){
+	SwapchainUserData(magma::Device<claws::no_delete> device, vk::Extent2D extent, vk::Format format, UserData &userData)
+	  : renderPass([&](){
 	      magma::RenderPassCreateInfo renderPassCreateInfo{{}};
 
 	      // We have a simple renderpass writting to an image.
 	      // The attached framebuffer will be cleared
 	      renderPassCreateInfo.attachements.push_back({{},
-		    swapchain.getFormat(),
+		    format,
 		      vk::SampleCountFlagBits::e1,
 		      vk::AttachmentLoadOp::eClear,
 		      vk::AttachmentStoreOp::eStore,
@@ -213,47 +244,266 @@ namespace display
 
 	      return device.createRenderPass(renderPassCreateInfo);
 	    }())
-	  , pipeline(createPipeline(device, swapchain, userData))
+	  , pipeline(createPipeline(extent, userData))
 	{
 	}
       };
 
+      // One per swapchain image
       struct FrameData
       {
-	magma::Fence<> fence;
 	magma::Framebuffer<> framebuffer;
+	// draws the scene to the image, recorded again only when the scene changes
+	magma::CommandBufferGroup<magma::PrimaryCommandBuffer> commandBuffers;
+	// sceneVersion the command buffer was recorded for, none before the first recording
+	std::optional<uint64_t> recordedVersion;
+	// signaled when the image has been rendered, presentation waits on it
+	// it belongs to the image rather than to a frame in flight: the image can't be acquired again before its present is done with it
+	magma::Semaphore<> renderDone;
+	// fence of the frame in flight that last rendered to the image
+	std::optional<magma::Fence<claws::no_delete>> renderFence;
 
-	FrameData(magma::Device<claws::no_delete> device, magma::Swapchain<claws::no_delete> swapchain, UserData &, SwapchainUserData &swapchainUserData, magma::ImageView<claws::no_delete> swapchainImageView)
-	  : fence(device.createFence(vk::FenceCreateFlagBits::eSignaled))
-	  , framebuffer(device.createFramebuffer(swapchainUserData.renderPass,
+	FrameData(magma::Device<claws::no_delete> device, vk::Extent2D extent, UserData &userData, SwapchainUserData &swapchainUserData, vk::ImageView swapchainImageView)
+	  : framebuffer(device.createFramebuffer(swapchainUserData.renderPass,
 						 std::vector<vk::ImageView>{swapchainImageView},
-						 swapchain.getExtent().width,
-						 swapchain.getExtent().height,
+						 extent.width,
+						 extent.height,
 						 1))
+	  , commandBuffers(userData.commandPool.allocatePrimaryCommandBuffers(1))
+	  , renderDone(device.createSemaphore())
+	{
+	}
+      };
+
+      // The swapchain and what is made for its images.
+      // It is created here rather than by magma's DisplaySystem, which has no say in the present mode.
+      struct Swapchain
+      {
+	// destroyed after the views of its images
+	struct Handle
+	{
+	  vk::Device device;
+	  vk::SwapchainKHR swapchain;
+
+	  ~Handle()
+	  {
+	    device.destroySwapchainKHR(swapchain);
+	  }
+	};
+
+	vk::SurfaceFormatKHR surfaceFormat;
+	vk::Extent2D extent;
+	Handle handle;
+	std::vector<magma::ImageView<>> imageViews;
+	SwapchainUserData userData;
+	// one per image
+	std::vector<FrameData> frames;
+
+	// B8G8R8A8 like the render pass expects everywhere, the first format otherwise
+	static vk::SurfaceFormatKHR selectSurfaceFormat(vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface)
+	{
+	  std::vector<vk::SurfaceFormatKHR> const surfaceFormats(physicalDevice.getSurfaceFormatsKHR(surface));
+
+	  for (vk::SurfaceFormatKHR const &surfaceFormat : surfaceFormats)
+	    if (surfaceFormat.format == vk::Format::eB8G8R8A8Unorm)
+	      return surfaceFormat;
+	  // a single undefined format leaves the choice to us
+	  if (surfaceFormats.empty() || surfaceFormats.front().format == vk::Format::eUndefined)
+	    return {vk::Format::eB8G8R8A8Unorm, vk::ColorSpaceKHR::eSrgbNonlinear};
+	  return surfaceFormats.front();
+	}
+
+	// The surface's size, or DEFAULT_EXTENT when the surface takes the swapchain's (Wayland)
+	static vk::Extent2D selectExtent(vk::SurfaceCapabilitiesKHR const &capabilities)
+	{
+	  static constexpr vk::Extent2D DEFAULT_EXTENT{1280, 720};
+
+	  if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max())
+	    return capabilities.currentExtent;
+	  return {std::clamp(DEFAULT_EXTENT.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width),
+		  std::clamp(DEFAULT_EXTENT.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height)};
+	}
+
+	// oldSwapchain is retired, null the first time
+	Swapchain(magma::Device<claws::no_delete> device, vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface, vk::PresentModeKHR presentMode,
+		  UserData &rendererUserData, vk::SwapchainKHR oldSwapchain)
+	  : surfaceFormat(selectSurfaceFormat(physicalDevice, surface))
+	  , extent(selectExtent(physicalDevice.getSurfaceCapabilitiesKHR(surface)))
+	  , handle{static_cast<vk::Device>(device), [&](){
+	      vk::SurfaceCapabilitiesKHR const capabilities(physicalDevice.getSurfaceCapabilitiesKHR(surface));
+	      // one more than the minimum, so that acquiring doesn't wait for the presentation engine to release an image
+	      uint32_t imageCount(capabilities.minImageCount + 1);
+	      vk::CompositeAlphaFlagBitsKHR compositeAlpha(vk::CompositeAlphaFlagBitsKHR::eOpaque);
+
+	      if (capabilities.maxImageCount)
+		imageCount = std::min(imageCount, capabilities.maxImageCount);
+	      for (vk::CompositeAlphaFlagBitsKHR candidate : {vk::CompositeAlphaFlagBitsKHR::eOpaque, vk::CompositeAlphaFlagBitsKHR::eInherit,
+							      vk::CompositeAlphaFlagBitsKHR::ePreMultiplied, vk::CompositeAlphaFlagBitsKHR::ePostMultiplied})
+		if (capabilities.supportedCompositeAlpha & candidate)
+		  {
+		    compositeAlpha = candidate;
+		    break;
+		  }
+	      return static_cast<vk::Device>(device).createSwapchainKHR({{},
+		    surface,
+		    imageCount,
+		    surfaceFormat.format,
+		    surfaceFormat.colorSpace,
+		    extent,
+		    1,
+		    vk::ImageUsageFlagBits::eColorAttachment,
+		    vk::SharingMode::eExclusive,
+		    0,
+		    nullptr,
+		    capabilities.currentTransform,
+		    compositeAlpha,
+		    presentMode,
+		    true, // clipped
+		    oldSwapchain});
+	    }()}
+	  , userData(device, extent, surfaceFormat.format, rendererUserData)
+	{
+	  std::vector<vk::Image> const images(handle.device.getSwapchainImagesKHR(handle.swapchain));
+
+	  imageViews.reserve(images.size());
+	  frames.reserve(images.size());
+	  for (vk::Image image : images)
+	    {
+	      imageViews.push_back(device.createImageView({},
+							  image,
+							  vk::ImageViewType::e2D,
+							  surfaceFormat.format,
+							  vk::ComponentMapping{},
+							  vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1)));
+	      frames.emplace_back(device, extent, rendererUserData, userData, imageViews.back());
+	    }
+	}
+
+	Swapchain(Swapchain const &) = delete;
+	Swapchain &operator=(Swapchain const &) = delete;
+      };
+
+      // Copies of the assets from the staging buffer to device local memory, they are used once it completes
+      struct Upload
+      {
+	// on the transfer queue family, the copies may run on another queue than the rendering
+	magma::CommandPool<> commandPool;
+	// copies on the transfer queue, then releases the assets to the graphics queue family
+	magma::CommandBufferGroup<magma::PrimaryCommandBuffer> transferCommandBuffers;
+	// acquires the assets on the graphics queue, only with a dedicated transfer queue family
+	magma::CommandBufferGroup<magma::PrimaryCommandBuffer> acquireCommandBuffers;
+	magma::Semaphore<> transferDone;
+	magma::Fence<> fence;
+
+	Upload(magma::Device<claws::no_delete> device, UserData &userData, uint32_t transferQueueFamily)
+	  : commandPool(device.createCommandPool({}, transferQueueFamily))
+	  , transferCommandBuffers(commandPool.allocatePrimaryCommandBuffers(1))
+	  , acquireCommandBuffers(userData.commandPool.allocatePrimaryCommandBuffers(1))
+	  , transferDone(device.createSemaphore())
+	  , fence(device.createFence({}))
+	{
+	}
+      };
+
+      // Copy of the surfaces to instanceBuffer, submitted only when they change
+      struct InstanceUpdate
+      {
+	magma::CommandBufferGroup<magma::PrimaryCommandBuffer> commandBuffers;
+	// signaled once the copy is done, the command buffer can be recorded again
+	magma::Fence<> fence;
+
+	InstanceUpdate(magma::Device<claws::no_delete> device, UserData &userData)
+	  : commandBuffers(userData.commandPool.allocatePrimaryCommandBuffers(1))
+	  , fence(device.createFence(vk::FenceCreateFlagBits::eSignaled))
+	{
+	}
+      };
+
+      // Synchronization of a frame the CPU submits while the GPU may still be executing the previous ones
+      struct FrameInFlight
+      {
+	// signaled once the GPU is done with the frame, so its semaphore can be reused
+	magma::Fence<> fence;
+	magma::Semaphore<> imageAvailable;
+
+	explicit FrameInFlight(magma::Device<claws::no_delete> device)
+	  : fence(device.createFence(vk::FenceCreateFlagBits::eSignaled))
+	  , imageAvailable(device.createSemaphore())
 	{
 	}
       };
+
       vk::PhysicalDevice physicalDevice;
+      vk::SurfaceKHR surface;
+      vk::PresentModeKHR presentMode;
+      // VK_KHR_present_id and VK_KHR_present_wait are enabled, frames are paced on their presents (see pace)
+      bool presentWait;
+      // the fallback without presentWait: VK_GOOGLE_display_timing is enabled, the presents report when they reached the screen
+      bool displayTiming;
+      // shaderSampledImageArrayNonUniformIndexing is enabled, the surfaces are drawn with a single instanced draw
+      bool nonUniformIndexing;
       magma::Device<> device;
-      magma::Semaphore<> imageAvailable;
-      magma::Semaphore<> renderDone;
+      // null without displayTiming
+      PFN_vkGetPastPresentationTimingGOOGLE getPastPresentationTiming;
+      // null without presentWait
+      PFN_vkWaitForPresentKHR waitForPresent;
+      // graphics and present
       vk::Queue queue;
-      magma::DisplaySystem<UserData, SwapchainUserData, FrameData> displaySystem;
+      uint32_t queueFamily;
+      // a transfer only queue when the device has one, it copies while the graphics queue renders, queue otherwise
+      vk::Queue transferQueue;
+      uint32_t transferQueueFamily;
+      UserData userData;
+      std::unique_ptr<Swapchain> swapchain;
+      // the last acquire or present reported the swapchain suboptimal or out of date, it is recreated before the next acquire
+      bool swapchainOutdated;
+      std::vector<FrameInFlight> framesInFlight;
+      // index in framesInFlight of the next frame to render
+      unsigned int currentFrame;
+      // bumped whenever what the command buffers draw changes, see invalidate
+      uint64_t sceneVersion;
+      // id of the next present, ids start at 1
+      uint64_t presentId;
+      // first id presented to the current swapchain, earlier ids will never complete on it
+      uint64_t swapchainFirstPresentId;
+      PresentLatency presentLatency;
+      // filled by collectPresentTimes, kept to reuse its storage
+      std::vector<VkPastPresentationTimingGOOGLE> pastPresentationTimings;
 
-      magma::Buffer<> quadBuffer;
-      magma::DeviceMemory<> quadBufferMemory;
+      // what setSurfaces was last given, drawn in order with one instanced draw (see record)
+      std::vector<SurfaceInstance> surfaces;
+      // surfaces for the vertex shader, copied from surfaces when they change (see updateInstances)
+      magma::Buffer<> instanceBuffer;
+      magma::DeviceMemory<> instanceBufferMemory;
+      InstanceUpdate instanceUpdate;
+      // surfaces changed since the last copy to instanceBuffer
+      bool instancesChanged;
       magma::DescriptorPool<> descriptorPool;
+      // allocated once: the instance buffer and the texture array, whose slots addTexture writes
       magma::DescriptorSets<> descriptorSets;
+      // slots of the texture array given out by addTexture, the others hold the background
+      uint32_t textureCount;
       magma::Image<> backgroundImage;
       magma::DeviceMemory<> backgroundImageMemory;
       magma::ImageView<> backgroundImageView;
       magma::DynamicBuffer stagingBuffer;
       magma::Sampler<> sampler;
+      Upload upload;
+      // the upload completed and the graphics queue owns the assets, until then frames are only cleared
+      bool assetsReady;
 
       struct Score
       {
 	bool isSuitable;
 	unsigned int bestQueue;
+	// a queue family with transfers only (a copy engine), bestQueue if there is none
+	unsigned int transferQueue;
+	// supports VK_KHR_present_id and VK_KHR_present_wait, see supportsPresentWait
+	bool presentWait;
+	// supports VK_GOOGLE_display_timing
+	bool displayTiming;
+	// supports shaderSampledImageArrayNonUniformIndexing, see supportsNonUniformIndexing
+	bool nonUniformIndexing;
 	vk::PhysicalDeviceType deviceType;
 
 	unsigned int deviceTypeScore() const noexcept
@@ -280,34 +530,161 @@ namespace display
 	}
       };
 
-      Renderer(std::pair<vk::PhysicalDevice, Score> const &selectedResult, magma::Surface<claws::no_delete> surface)
+      static bool hasExtension(vk::PhysicalDevice physicalDevice, char const *name)
+      {
+	std::vector<vk::ExtensionProperties> const extensions(physicalDevice.enumerateDeviceExtensionProperties());
+
+	return std::any_of(extensions.begin(), extensions.end(), [name](vk::ExtensionProperties const &extension)
+			   {
+			     return !strcmp(extension.extensionName, name);
+			   });
+      }
+
+      // The requested mode, or FIFO when the surface doesn't support it or present wait can't pace it.
+      // FIFO is the only mode every surface supports, and its presents pace the frames by themselves.
+      static vk::PresentModeKHR selectPresentMode(vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface, vk::PresentModeKHR requested, bool presentWait)
+      {
+	if (requested == vk::PresentModeKHR::eFifo)
+	  return requested;
+	if (!presentWait)
+	  {
+	    std::cerr << "present mode " << vk::to_string(requested) << " needs VK_KHR_present_wait to be paced, using FIFO" << std::endl;
+	    return vk::PresentModeKHR::eFifo;
+	  }
+
+	std::vector<vk::PresentModeKHR> const presentModes(physicalDevice.getSurfacePresentModesKHR(surface));
+
+	if (std::find(presentModes.begin(), presentModes.end(), requested) != presentModes.end())
+	  return requested;
+	std::cerr << "present mode " << vk::to_string(requested) << " is not supported, using FIFO" << std::endl;
+	return vk::PresentModeKHR::eFifo;
+      }
+
+      // VK_KHR_present_id and VK_KHR_present_wait with their features, queried like supportsNonUniformIndexing's
+      static bool supportsPresentWait(vk::PhysicalDevice physicalDevice)
+      {
+	if (physicalDevice.getProperties().apiVersion < VK_API_VERSION_1_1 ||
+	    !hasExtension(physicalDevice, VK_KHR_PRESENT_ID_EXTENSION_NAME) || !hasExtension(physicalDevice, VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+	  return false;
+
+	auto const features(physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDevicePresentIdFeaturesKHR, vk::PhysicalDevicePresentWaitFeaturesKHR>());
+
+	return features.get<vk::PhysicalDevicePresentIdFeaturesKHR>().presentId && features.get<vk::PhysicalDevicePresentWaitFeaturesKHR>().presentWait;
+      }
+
+      // VK_EXT_descriptor_indexing with non uniform indexing of sampled image arrays.
+      // The features are queried with vkGetPhysicalDeviceFeatures2, core since Vulkan 1.1.
+      static bool supportsNonUniformIndexing(vk::PhysicalDevice physicalDevice)
+      {
+	if (physicalDevice.getProperties().apiVersion < VK_API_VERSION_1_1 || !hasExtension(physicalDevice, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME))
+	  return false;
+
+	auto const features(physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>());
+
+	return features.get<vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>().shaderSampledImageArrayNonUniformIndexing;
+      }
+
+      Renderer(std::pair<vk::PhysicalDevice, Score> const &selectedResult, magma::Surface<claws::no_delete> surface, unsigned int frameInFlightCount,
+	       vk::PresentModeKHR requestedPresentMode)
 	: physicalDevice(selectedResult.first)
-	, device([this, &selectedResult, surface](){
-	    float priority{1.0f};
-	    vk::DeviceQueueCreateInfo deviceQueueCreateInfo{{}, selectedResult.second.bestQueue, 1, &priority};
+	, surface(surface)
+	, presentMode(selectPresentMode(physicalDevice, this->surface, requestedPresentMode, selectedResult.second.presentWait))
+	, presentWait(selectedResult.second.presentWait)
+	, displayTiming(!presentWait && selectedResult.second.displayTiming)
+	, nonUniformIndexing(selectedResult.second.nonUniformIndexing)
+	, device([this, &selectedResult](){
+	    static float const priority{1.0f};
+	    std::vector<vk::DeviceQueueCreateInfo> deviceQueueCreateInfos{{{}, selectedResult.second.bestQueue, 1, &priority}};
+	    std::vector<char const *> extensions{VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+	    vk::PhysicalDeviceFeatures2 features;
+	    vk::PhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures;
+	    vk::PhysicalDevicePresentIdFeaturesKHR presentIdFeatures;
+	    vk::PhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures;
+	    // where the next features struct of the chain goes
+	    void **next(&features.pNext);
+
+	    if (selectedResult.second.transferQueue != selectedResult.second.bestQueue)
+	      deviceQueueCreateInfos.push_back({{}, selectedResult.second.transferQueue, 1, &priority});
+	    if (displayTiming)
+	      extensions.push_back(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+	    // the texture index is at least dynamically uniform, see record
+	    features.features.shaderSampledImageArrayDynamicIndexing = true;
+	    if (nonUniformIndexing)
+	      {
+		extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+		// its dependency, core in the Vulkan 1.1 this device has
+		if (hasExtension(physicalDevice, VK_KHR_MAINTENANCE3_EXTENSION_NAME))
+		  extensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+		descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = true;
+		*next = &descriptorIndexingFeatures;
+		next = &descriptorIndexingFeatures.pNext;
+	      }
+	    if (presentWait)
+	      {
+		extensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+		extensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+		presentIdFeatures.presentId = true;
+		presentWaitFeatures.presentWait = true;
+		presentIdFeatures.pNext = &presentWaitFeatures;
+		*next = &presentIdFeatures;
+	      }
+
+	    vk::DeviceCreateInfo createInfo({},
+					    static_cast<uint32_t>(deviceQueueCreateInfos.size()), deviceQueueCreateInfos.data(),
+					    0, nullptr,
+					    0, nullptr,
+					    &features.features);
 
-	    return magma::Device<>(physicalDevice,
-				   std::vector<vk::DeviceQueueCreateInfo>({deviceQueueCreateInfo}),
-				   std::vector<char const *>({VK_KHR_SWAPCHAIN_EXTENSION_NAME}));
+	    // the extension features chain to VkPhysicalDeviceFeatures2, which then holds the core ones too
+	    if (features.pNext)
+	      {
+		createInfo.pEnabledFeatures = nullptr;
+		createInfo.pNext = &features;
+	      }
+	    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	    createInfo.ppEnabledExtensionNames = extensions.data();
+	    // magma's Device takes no features, it owns the device created here like it owns the ones it creates
+	    return magma::Device<>(physicalDevice.createDevice(createInfo));
 	  }())
-	, imageAvailable(device.createSemaphore())
-	, renderDone(device.createSemaphore())
+	, getPastPresentationTiming(displayTiming ?
+				    reinterpret_cast<PFN_vkGetPastPresentationTimingGOOGLE>(vkGetDeviceProcAddr(static_cast<VkDevice>(static_cast<vk::Device>(device)),
+														  "vkGetPastPresentationTimingGOOGLE")) :
+				    nullptr)
+	, waitForPresent(presentWait ?
+			 reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(static_cast<VkDevice>(static_cast<vk::Device>(device)), "vkWaitForPresentKHR")) :
+			 nullptr)
 	, queue(device.getQueue(selectedResult.second.bestQueue, 0u))
-	, displaySystem(physicalDevice, surface, device, queue, selectedResult.second.bestQueue)
-	, quadBuffer(device.createBuffer({}, 8 * sizeof(float), vk::BufferUsageFlagBits::eVertexBuffer, {selectedResult.second.bestQueue}))
-	, quadBufferMemory([this](){
-	    auto memRequirements(device.getBufferMemoryRequirements(quadBuffer));
+	, queueFamily(selectedResult.second.bestQueue)
+	, transferQueue(device.getQueue(selectedResult.second.transferQueue, 0u))
+	, transferQueueFamily(selectedResult.second.transferQueue)
+	, userData(device, physicalDevice, queueFamily)
+	, swapchain(std::make_unique<Swapchain>(device, physicalDevice, this->surface, presentMode, userData, nullptr))
+	, swapchainOutdated(false)
+	, currentFrame(0)
+	, sceneVersion(0)
+	, presentId(1)
+	, swapchainFirstPresentId(1)
+	, instanceBuffer(device.createBuffer({}, MAX_SURFACES * sizeof(SurfaceInstance), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, {queueFamily}))
+	, instanceBufferMemory([this](){
+	    auto memRequirements(device.getBufferMemoryRequirements(instanceBuffer));
 
-	    return device.selectAndCreateDeviceMemory(physicalDevice, memRequirements.size, vk::MemoryPropertyFlagBits::eHostVisible, memRequirements.memoryTypeBits);
+	    return device.selectAndCreateDeviceMemory(physicalDevice, memRequirements.size, vk::MemoryPropertyFlagBits::eDeviceLocal, memRequirements.memoryTypeBits);
 	  }())
-	, descriptorPool(device.createDescriptorPool(1, {vk::DescriptorPoolSize{vk::DescriptorType::eCombinedImageSampler, 1}}))
-	, descriptorSets(descriptorPool.allocateDescriptorSets({displaySystem.userData.descriptorSetLayout}))
+	, instanceUpdate(device, userData)
+	, instancesChanged(true)
+	, descriptorPool(device.createDescriptorPool(1,
+						     {
+						       vk::DescriptorPoolSize{vk::DescriptorType::eStorageBuffer, 1},
+						       vk::DescriptorPoolSize{vk::DescriptorType::eCombinedImageSampler, MAX_TEXTURES}
+						     }))
+	, descriptorSets(descriptorPool.allocateDescriptorSets({userData.descriptorSetLayout}))
+	, textureCount(0)
 	, backgroundImage(device.createImage2D({}, vk::Format::eR8G8B8A8Unorm, {display::superCorbeau::width, display::superCorbeau::height}, vk::SampleCountFlagBits::e1,
 					       vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst, vk::ImageLayout::eUndefined))
 	, backgroundImageMemory([this](){
 	    auto memRequirements(device.getImageMemoryRequirements(backgroundImage));
 
-	    auto memory(device.selectAndCreateDeviceMemory(physicalDevice, memRequirements.size, vk::MemoryPropertyFlagBits::eHostVisible, memRequirements.memoryTypeBits));
+	    auto memory(device.selectAndCreateDeviceMemory(physicalDevice, memRequirements.size, vk::MemoryPropertyFlagBits::eDeviceLocal, memRequirements.memoryTypeBits));
 	    device.bindImageMemory(backgroundImage, memory, 0);
 	    return memory;
 	  }())
@@ -326,7 +703,7 @@ namespace display
 			{},
 			vk::BufferUsageFlagBits::eTransferSrc,
 			vk::MemoryPropertyFlagBits::eHostVisible,
-			std::vector<uint32_t>{selectedResult.second.bestQueue})
+			std::vector<uint32_t>{transferQueueFamily})
 	, sampler(device.createSampler(vk::Filter::eNearest,
 				       vk::Filter::eNearest,
 				       vk::SamplerMipmapMode::eNearest,
@@ -342,96 +719,158 @@ namespace display
 				       0.0f,
 				       vk::BorderColor::eIntOpaqueWhite,
 				       false))
+	, upload(device, userData, transferQueueFamily)
+	, assetsReady(false)
+      {
+	framesInFlight.reserve(frameInFlightCount);
+	for (unsigned int i = 0; i < frameInFlightCount; ++i)
+	  framesInFlight.emplace_back(device);
+
+	device.bindBufferMemory(instanceBuffer, instanceBufferMemory, 0);
+	{
+	  vk::DescriptorBufferInfo const instanceBufferInfo{instanceBuffer, 0, VK_WHOLE_SIZE};
+	  // every slot has to hold a valid image, the background stands in for the textures to come
+	  std::vector<vk::DescriptorImageInfo> const imageInfos(MAX_TEXTURES, vk::DescriptorImageInfo{sampler, backgroundImageView, vk::ImageLayout::eShaderReadOnlyOptimal});
+
+	  device.updateDescriptorSets(std::array<vk::WriteDescriptorSet, 2u>{
+	      vk::WriteDescriptorSet{descriptorSets[0], 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &instanceBufferInfo, nullptr},
+		vk::WriteDescriptorSet{descriptorSets[0], 1, 0, MAX_TEXTURES, vk::DescriptorType::eCombinedImageSampler, imageInfos.data(), nullptr, nullptr}
+	    });
+	}
+	// the background is the only surface until setSurfaces is called
+	surfaces.push_back({{0.0f, 0.0f}, {static_cast<float>(display::superCorbeau::width), static_cast<float>(display::superCorbeau::height)},
+			    addTexture(backgroundImageView), 0});
+	startUpload();
+      }
+
+      // Stages the background image, and copies it to its device local memory on the transfer queue.
+      // Nothing waits for the copies, render picks them up once they are done.
+      void startUpload()
       {
+	bool const transferOwnership(transferQueueFamily != queueFamily);
+	// with a single queue family the barriers keep the families ignored, nothing changes hands
+	uint32_t const srcQueueFamily(transferOwnership ? transferQueueFamily : VK_QUEUE_FAMILY_IGNORED);
+	uint32_t const dstQueueFamily(transferOwnership ? queueFamily : VK_QUEUE_FAMILY_IGNORED);
+	vk::ImageSubresourceRange imageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1};
+	magma::DynamicBuffer::RangeId imageStaging(stagingBuffer.allocate(display::superCorbeau::width * display::superCorbeau::height * 4));
+
 	{
-	  magma::DynamicBuffer::RangeId tmpBuffer(stagingBuffer.allocate(display::superCorbeau::width * display::superCorbeau::height * 4));
-	  auto memory(stagingBuffer.getMemory<unsigned char []>(tmpBuffer));
-	  auto src(display::superCorbeau::header_data);
-	  for (unsigned int i(0u); i < display::superCorbeau::width * display::superCorbeau::height; ++i)
-	    display::superCorbeau::headerPixel(src, &memory[i * 4]);
-	  auto commandBuffers(displaySystem.userData.commandPool.allocatePrimaryCommandBuffers(1));
-	  commandBuffers[0].begin(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-	  vk::ImageSubresourceRange imageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1};
-
-	  commandBuffers[0].raw().pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, {}, {},
-						  {
-						    vk::ImageMemoryBarrier{
-						      {},
+	  auto memory(stagingBuffer.getMemory<unsigned char []>(imageStaging));
+	  std::array<unsigned char, display::superCorbeau::width * display::superCorbeau::height * 3> rgb;
+
+	  display::superCorbeau::decode(rgb.data());
+	  pixel::expandRgb888(&memory[0], 0, rgb.data(), 0, display::superCorbeau::width * display::superCorbeau::height, 1, pixel::RGB_TO_RGBX);
+	}
+
+	magma::PrimaryCommandBuffer transferCommandBuffer(upload.transferCommandBuffers[0]);
+
+	transferCommandBuffer.begin(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+	transferCommandBuffer.raw().pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, {}, {},
+						    {
+						      vk::ImageMemoryBarrier{
+							{},
+							  vk::AccessFlagBits::eTransferWrite,
+							    vk::ImageLayout::eUndefined,
+							    vk::ImageLayout::eTransferDstOptimal,
+							    VK_QUEUE_FAMILY_IGNORED,
+							    VK_QUEUE_FAMILY_IGNORED,
+							    backgroundImage,
+							    imageSubresourceRange
+							    }
+						    });
+	transferCommandBuffer.raw().copyBufferToImage(stagingBuffer.getBuffer(imageStaging),
+						      backgroundImage,
+						      vk::ImageLayout::eTransferDstOptimal,
+						      {
+							vk::BufferImageCopy{
+							  imageStaging.second,
+							    0, 0,
+							    vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, 0, 0, 1},
+							    vk::Offset3D{0, 0, 0},
+							      vk::Extent3D{display::superCorbeau::width, display::superCorbeau::height, 1}
+							}
+						      });
+	// releases the assets to the graphics queue family, or makes them visible to the rendering when it's the same
+	transferCommandBuffer.raw().pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+						    transferOwnership ? vk::PipelineStageFlagBits::eBottomOfPipe : vk::PipelineStageFlagBits::eFragmentShader,
+						    {}, {}, {},
+						    {
+						      vk::ImageMemoryBarrier{
 							vk::AccessFlagBits::eTransferWrite,
-							  vk::ImageLayout::eUndefined,
+							  transferOwnership ? vk::AccessFlags{} : vk::AccessFlagBits::eShaderRead,
 							  vk::ImageLayout::eTransferDstOptimal,
-							  VK_QUEUE_FAMILY_IGNORED,
-							  VK_QUEUE_FAMILY_IGNORED,
+							  vk::ImageLayout::eShaderReadOnlyOptimal,
+							  srcQueueFamily,
+							  dstQueueFamily,
 							  backgroundImage,
 							  imageSubresourceRange
 							  }
-						  });
-	  commandBuffers[0].raw().copyBufferToImage(stagingBuffer.getBuffer(tmpBuffer),
-						    backgroundImage,
-						    vk::ImageLayout::eTransferDstOptimal,
-						    {
-						      vk::BufferImageCopy{
-							tmpBuffer.second,
-							  0, 0,
-							  vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, 0, 0, 1},
-							  vk::Offset3D{0, 0, 0},
-							    vk::Extent3D{display::superCorbeau::width, display::superCorbeau::height, 1}
-						      }
 						    });
-	  ;
-	  commandBuffers[0].raw().pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, {}, {},
-						  {
-						    vk::ImageMemoryBarrier{
-						      vk::AccessFlagBits::eTransferWrite,
-							vk::AccessFlagBits::eShaderRead,
-							vk::ImageLayout::eTransferDstOptimal,
-							vk::ImageLayout::eShaderReadOnlyOptimal,
-							VK_QUEUE_FAMILY_IGNORED,
-							VK_QUEUE_FAMILY_IGNORED,
-							backgroundImage,
-							imageSubresourceRange
-							}
-						  });
-
-	  commandBuffers[0].end();
-	  magma::Fence<> fence(device.createFence({}));
-	  queue.submit(magma::StructBuilder<vk::SubmitInfo>::make(magma::EmptyList(),
-								  nullptr,
-								  magma::asListRef(commandBuffers[0].raw()),
-								  magma::EmptyList()),
-		       fence);
-	  device.waitForFences({fence}, true, 1000000000);
-	}
+	transferCommandBuffer.end();
 
-	vk::DescriptorImageInfo const imageInfo
-	{
-	  sampler,
-	    backgroundImageView,
-	    vk::ImageLayout::eShaderReadOnlyOptimal
-	    };
-	device.updateDescriptorSets(std::array<vk::WriteDescriptorSet, 1u>{vk::WriteDescriptorSet{descriptorSets[0], 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &imageInfo, nullptr, nullptr}});
-	device.bindBufferMemory(quadBuffer, quadBufferMemory, 0);
-	{
-	  auto deleter([&](auto data)
-		       {
-			 if (data)
-			   device.unmapMemory(quadBufferMemory);
-		       });
-	  std::unique_ptr<float[], decltype(deleter)> quadData(reinterpret_cast<float *>(device.mapMemory(quadBufferMemory, 0, VK_WHOLE_SIZE)),
-							       deleter);
-	  quadData[0] = 0.0f;
-	  quadData[1] = 0.0f;
-	  quadData[2] = 100.0f;
-	  quadData[3] = 0.0f;
-	  quadData[4] = 0.0f;
-	  quadData[5] = 100.0f;
-	  quadData[6] = 100.0f;
-	  quadData[7] = 100.0f;
-	}
+	if (transferOwnership)
+	  {
+	    // the acquire half of the ownership transfer, the barriers match the release ones
+	    magma::PrimaryCommandBuffer acquireCommandBuffer(upload.acquireCommandBuffers[0]);
+
+	    acquireCommandBuffer.begin(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+	    acquireCommandBuffer.raw().pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+						       vk::PipelineStageFlagBits::eFragmentShader,
+						       {}, {}, {},
+						       {
+							 vk::ImageMemoryBarrier{
+							   {},
+							     vk::AccessFlagBits::eShaderRead,
+							     vk::ImageLayout::eTransferDstOptimal,
+							     vk::ImageLayout::eShaderReadOnlyOptimal,
+							     srcQueueFamily,
+							     dstQueueFamily,
+							     backgroundImage,
+							     imageSubresourceRange
+							     }
+						       });
+	    acquireCommandBuffer.end();
+	    transferQueue.submit(magma::StructBuilder<vk::SubmitInfo>::make(magma::EmptyList(),
+									    nullptr,
+									    magma::asListRef(transferCommandBuffer.raw()),
+									    magma::asListRef(upload.transferDone)),
+				 upload.fence);
+	  }
+	else
+	  {
+	    transferQueue.submit(magma::StructBuilder<vk::SubmitInfo>::make(magma::EmptyList(),
+									    nullptr,
+									    magma::asListRef(transferCommandBuffer.raw()),
+									    magma::EmptyList()),
+				 upload.fence);
+	  }
+      }
+
+      // Once the copies are done, hands the assets to the rendering without waiting for anything
+      void pollUpload()
+      {
+	// magma has no fence status query, the core entry point is called like the other raw calls
+	if (vkGetFenceStatus(static_cast<VkDevice>(static_cast<vk::Device>(device)),
+			     static_cast<VkFence>(static_cast<vk::Fence>(upload.fence))) != VK_SUCCESS)
+	  return;
+	if (transferQueueFamily != queueFamily)
+	  {
+	    // ordered before the frames submitted next, whose reads wait for the acquire barrier
+	    vk::PipelineStageFlags waitDestStageMask(vk::PipelineStageFlagBits::eTopOfPipe);
+
+	    queue.submit(magma::StructBuilder<vk::SubmitInfo>::make(magma::asListRef(upload.transferDone),
+								    &waitDestStageMask,
+								    magma::asListRef(upload.acquireCommandBuffers[0].raw()),
+								    magma::EmptyList()),
+			 vk::Fence{});
+	  }
+	assetsReady = true;
+	invalidate();
       }
 
     public:
-      Renderer(magma::Instance const &instance, magma::Surface<claws::no_delete> surface)
+      // Up to frameInFlightCount (at least 1) frames are recorded and queued while the GPU renders the previous ones
+      Renderer(magma::Instance const &instance, magma::Surface<claws::no_delete> surface, unsigned int frameInFlightCount, vk::PresentModeKHR presentMode)
 	: Renderer([&instance, surface](){
 	    std::pair<vk::PhysicalDevice, Score>
 	      result(instance.selectDevice([&instance, surface]
@@ -449,68 +888,314 @@ namespace display
 						     break;
 						   }
 					       }
+					     // a family without graphics nor compute is a copy engine, copies there don't slow the rendering down
+					     unsigned int transferQueueIndex = 0;
+					     for (; transferQueueIndex < queueFamilyPropertiesList.size(); ++transferQueueIndex)
+					       {
+						 vk::QueueFlags const queueFlags(queueFamilyPropertiesList[transferQueueIndex].queueFlags);
+
+						 if ((queueFlags & vk::QueueFlagBits::eTransfer) &&
+						     !(queueFlags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)))
+						   {
+						     break;
+						   }
+					       }
+					     if (transferQueueIndex == queueFamilyPropertiesList.size())
+					       transferQueueIndex = bestQueueIndex;
 					     vk::PhysicalDeviceProperties properties(physicalDevice.getProperties());
-					     return Score{bestQueueIndex != queueFamilyPropertiesList.size(), bestQueueIndex, properties.deviceType};
+					     // the texture array is indexed with the texture of the surface, see record
+					     bool const dynamicIndexing(physicalDevice.getFeatures().shaderSampledImageArrayDynamicIndexing);
+					     return Score{dynamicIndexing && bestQueueIndex != queueFamilyPropertiesList.size(),
+							  bestQueueIndex, transferQueueIndex,
+							  supportsPresentWait(physicalDevice),
+							  hasExtension(physicalDevice, VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME),
+							  supportsNonUniformIndexing(physicalDevice), properties.deviceType};
 					   }));
 	    if (!result.second.isSuitable)
 	      {
 		throw std::runtime_error("No suitable GPU found.");
 	      }
 	    return result;
-	  }(), surface)
+	  }(), surface, frameInFlightCount, presentMode)
       {
       }
 
       ~Renderer() noexcept
       {
 	try {
-	  quadBuffer = magma::Buffer<>{}; // destroy buffer before memory being free'd
+	  // frames in flight and the upload still use the semaphores, buffers and images
+	  queue.waitIdle();
+	  transferQueue.waitIdle();
+	  instanceBuffer = magma::Buffer<>{}; // destroy buffer before memory being free'd
 	  backgroundImage = magma::Image<>{}; // destroy image before memory being free'd
 	} catch (...) {
-	  std::cerr << "swallowing error: failed to destroy quadBuffer\n" << std::endl;
+	  std::cerr << "swallowing error: failed to destroy instanceBuffer\n" << std::endl;
 	}
       }
 
-      void render()
+    private:
+      // Records the draw of the scene to the image of frame, the GPU must be done with its command buffer
+      void record(FrameData &frame)
       {
-	// get next image data, and image to present
-	auto [index, frame] = displaySystem.getImage(imageAvailable);
-
-	// wait for rendering fence
-	device.waitForFences({frame.fence}, true, 1000000000);
-	// reset fence
-	device.resetFences({frame.fence});
-	magma::PrimaryCommandBuffer cmdBuffer(displaySystem.swapchainUserData.commandBuffers[index]);
-	uint32_t const vertexCount(4u);
+	magma::PrimaryCommandBuffer cmdBuffer(frame.commandBuffers[0]);
+	// a quad per surface, until the upload is done the frame is only cleared
+	bool const drawSurfaces(assetsReady && !surfaces.empty());
 
-	// being command recording
-	cmdBuffer.begin(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-	// we bind are quad buffer to both bindings
-	cmdBuffer.bindVertexBuffers(0, {quadBuffer}, {0ul});
-	cmdBuffer.bindVertexBuffers(1, {quadBuffer}, {0ul});
-	// we bind update our descriptor so that it points to our image
-	cmdBuffer.raw().bindDescriptorSets(vk::PipelineBindPoint::eGraphics, displaySystem.userData.pipelineLayout, 0, 1, descriptorSets.data(), 0, nullptr);
+	// being command recording, the buffer is submitted once per frame until the scene changes
+	cmdBuffer.begin({});
 	vk::ClearValue clearValue = {vk::ClearColorValue(std::array<float, 4>{0.0f, 0.5f, 0.0f, 1.0f})}; // a nice recognisable green for debug
 	{
 	  // start the renderpass
-	  auto lock(cmdBuffer.beginRenderPass(displaySystem.swapchainUserData.renderPass, frame.framebuffer,
-					      {{0, 0}, displaySystem.getSwapchain().getExtent()}, {clearValue}, vk::SubpassContents::eInline));
+	  auto lock(cmdBuffer.beginRenderPass(swapchain->userData.renderPass, frame.framebuffer,
+					      {{0, 0}, swapchain->extent}, {clearValue}, vk::SubpassContents::eInline));
+
+	  if (drawSurfaces)
+	    {
+	      // us our pipeline
+	      cmdBuffer.raw().bindPipeline(vk::PipelineBindPoint::eGraphics, swapchain->userData.pipeline);
+	      cmdBuffer.raw().bindDescriptorSets(vk::PipelineBindPoint::eGraphics, userData.pipelineLayout, 0, 1, descriptorSets.data(), 0, nullptr);
+	      if (nonUniformIndexing)
+		{
+		  // every surface in one instanced draw, each samples its own texture
+		  lock.draw(4u, static_cast<uint32_t>(surfaces.size()), 0, 0);
+		}
+	      else
+		{
+		  // the texture index must be dynamically uniform: one instanced draw per run of surfaces sharing a texture,
+		  // gl_InstanceIndex counts from the first one
+		  for (std::size_t first = 0; first < surfaces.size();)
+		    {
+		      std::size_t last(first + 1);
 
-	  // us our pipeline
-	  lock.bindGraphicsPipeline(displaySystem.swapchainUserData.pipeline);
-	  // draw our quad
-	  lock.draw(vertexCount, 1, 0, 0);
+		      while (last < surfaces.size() && surfaces[last].texture == surfaces[first].texture)
+			++last;
+		      lock.draw(4u, static_cast<uint32_t>(last - first), 0, static_cast<uint32_t>(first));
+		      first = last;
+		    }
+		}
+	    }
 	}
 	cmdBuffer.end();
+      }
+
+      // Copies the surfaces to instanceBuffer, ahead of the frames on the same queue.
+      // The barriers order the copy after the reads of the frames submitted before, and before the reads of the next ones.
+      void updateInstances()
+      {
+	vk::DeviceSize const instancesSize(surfaces.size() * sizeof(SurfaceInstance));
+	magma::PrimaryCommandBuffer cmdBuffer(instanceUpdate.commandBuffers[0]);
+
+	instancesChanged = false;
+	// nothing is drawn, there's nothing to copy
+	if (surfaces.empty())
+	  return;
+	// only the previous copy, it was submitted before frames that are mostly done by now
+	device.waitForFences({instanceUpdate.fence}, true, std::numeric_limits<uint64_t>::max());
+	device.resetFences({instanceUpdate.fence});
+	cmdBuffer.begin(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+	cmdBuffer.raw().pipelineBarrier(vk::PipelineStageFlagBits::eVertexShader, vk::PipelineStageFlagBits::eTransfer, {}, {},
+					{vk::BufferMemoryBarrier{{}, vk::AccessFlagBits::eTransferWrite, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, instanceBuffer, 0, instancesSize}},
+					{});
+	cmdBuffer.raw().updateBuffer(instanceBuffer, 0, instancesSize, surfaces.data());
+	cmdBuffer.raw().pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eVertexShader, {}, {},
+					{vk::BufferMemoryBarrier{vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, instanceBuffer, 0, instancesSize}},
+					{});
+	cmdBuffer.end();
+	queue.submit(magma::StructBuilder<vk::SubmitInfo>::make(magma::EmptyList(),
+								nullptr,
+								magma::asListRef(cmdBuffer.raw()),
+								magma::EmptyList()),
+		     instanceUpdate.fence);
+      }
+
+      // Feeds the presents that reached the screen since the last call to presentLatency.
+      // Their times are CLOCK_MONOTONIC nanoseconds, the clock of steady_clock.
+      void collectPresentTimes()
+      {
+	VkDevice const rawDevice(static_cast<vk::Device>(device));
+	VkSwapchainKHR const rawSwapchain(swapchain->handle.swapchain);
+	uint32_t count(0);
+
+	if (getPastPresentationTiming(rawDevice, rawSwapchain, &count, nullptr) != VK_SUCCESS || !count)
+	  return;
+	pastPresentationTimings.resize(count);
+	// VK_INCOMPLETE keeps the rest for the next call
+	if (getPastPresentationTiming(rawDevice, rawSwapchain, &count, pastPresentationTimings.data()) < 0)
+	  return;
+	for (uint32_t i = 0; i < count; ++i)
+	  presentLatency.presented(pastPresentationTimings[i].presentID,
+				   std::chrono::steady_clock::time_point(std::chrono::nanoseconds(pastPresentationTimings[i].actualPresentTime)));
+      }
+
+      // The frames in flight still render to the images and wait on their semaphores, then the old swapchain is retired to the new one
+      void recreateSwapchain()
+      {
+	queue.waitIdle();
+	swapchain = std::make_unique<Swapchain>(device, physicalDevice, surface, presentMode, userData, swapchain->handle.swapchain);
+	swapchainOutdated = false;
+	swapchainFirstPresentId = presentId;
+      }
+
+      // Acquires the next image, the swapchain is recreated first when it is outdated
+      std::pair<uint32_t, FrameData &> acquireImage(vk::Semaphore imageAvailable)
+      {
+	while (true)
+	  {
+	    uint32_t index(0);
+
+	    if (swapchainOutdated)
+	      recreateSwapchain();
+
+	    vk::Result const result(static_cast<vk::Device>(device).acquireNextImageKHR(swapchain->handle.swapchain, std::numeric_limits<uint64_t>::max(),
+											 imageAvailable, nullptr, &index));
+
+	    if (result == vk::Result::eErrorOutOfDateKHR)
+	      {
+		swapchainOutdated = true;
+		continue;
+	      }
+	    if (result != vk::Result::eSuccess && result != vk::Result::eSuboptimalKHR)
+	      throw std::runtime_error("Cannot acquire swapchain image: " + vk::to_string(result));
+	    // a suboptimal swapchain still takes this frame
+	    swapchainOutdated = result == vk::Result::eSuboptimalKHR;
+	    return {index, swapchain->frames[index]};
+	  }
+      }
+
+      // Presents with the present id chained for present wait, or with the display timing one in the fallback.
+      // A suboptimal or out of date swapchain is recreated before the next acquire.
+      void present(vk::Semaphore renderDone, uint32_t imageIndex)
+      {
+	vk::SwapchainKHR const presentSwapchain(swapchain->handle.swapchain);
+	vk::PresentIdKHR const presentIdInfo{1, &presentId};
+	vk::PresentTimeGOOGLE const presentTime{static_cast<uint32_t>(presentId), 0};
+	vk::PresentTimesInfoGOOGLE const presentTimesInfo{1, &presentTime};
+	vk::PresentInfoKHR presentInfo{1, &renderDone, 1, &presentSwapchain, &imageIndex, nullptr};
+
+	if (presentWait)
+	  presentInfo.pNext = &presentIdInfo;
+	else if (displayTiming)
+	  presentInfo.pNext = &presentTimesInfo;
+
+	vk::Result const result(queue.presentKHR(&presentInfo));
+
+	if (result == vk::Result::eSuboptimalKHR || result == vk::Result::eErrorOutOfDateKHR)
+	  swapchainOutdated = true;
+	else if (result != vk::Result::eSuccess)
+	  throw std::runtime_error("Cannot present: " + vk::to_string(result));
+      }
+
+    public:
+      // The scene changed, every image records its command buffer again before its next frame
+      void invalidate() noexcept
+      {
+	++sceneVersion;
+      }
+
+      // Makes imageView, in the shader read only layout, available to the surfaces as the returned texture index.
+      // Its slot of the texture array is written once the frames in flight, which use the set, are done.
+      uint32_t addTexture(vk::ImageView imageView)
+      {
+	if (textureCount == MAX_TEXTURES)
+	  throw std::runtime_error("Too many textures");
+
+	vk::DescriptorImageInfo const imageInfo{sampler, imageView, vk::ImageLayout::eShaderReadOnlyOptimal};
+
+	for (FrameInFlight const &frameInFlight : framesInFlight)
+	  device.waitForFences({frameInFlight.fence}, true, std::numeric_limits<uint64_t>::max());
+	device.updateDescriptorSets(std::array<vk::WriteDescriptorSet, 1u>{
+	    vk::WriteDescriptorSet{descriptorSets[0], 1, textureCount, 1, vk::DescriptorType::eCombinedImageSampler, &imageInfo, nullptr, nullptr}
+	  });
+	// the update invalidates the command buffers the set is bound in
+	invalidate();
+	return textureCount++;
+      }
+
+      // Surfaces to draw from now on, back to front
+      void setSurfaces(std::vector<SurfaceInstance> newSurfaces)
+      {
+	if (newSurfaces.size() > MAX_SURFACES)
+	  throw std::runtime_error("Too many surfaces");
+	surfaces = std::move(newSurfaces);
+	instancesChanged = true;
+	invalidate();
+      }
+
+      vk::PresentModeKHR getPresentMode() const noexcept
+      {
+	return presentMode;
+      }
+
+      PresentLatency const &getPresentLatency() const noexcept
+      {
+	return presentLatency;
+      }
+
+      // Waits until at most framesInFlight.size() presents are queued: the next acquire doesn't block,
+      // and the frame is drawn as late as the present mode lets it be shown. Without present wait it returns at once.
+      // A present that doesn't complete in time (hidden window...) only costs PRESENT_WAIT_TIMEOUT.
+      void pace()
+      {
+	static constexpr uint64_t PRESENT_WAIT_TIMEOUT = 100'000'000; // ns
+
+	if (!presentWait || presentId <= framesInFlight.size())
+	  return;
+
+	uint64_t const pacedId(presentId - framesInFlight.size());
+
+	// a recreated swapchain never presented the earlier ids
+	if (pacedId < swapchainFirstPresentId)
+	  return;
+
+	VkResult const result(waitForPresent(static_cast<VkDevice>(static_cast<vk::Device>(device)), static_cast<VkSwapchainKHR>(swapchain->handle.swapchain),
+					     pacedId, PRESENT_WAIT_TIMEOUT));
+
+	if (result == VK_SUCCESS)
+	  presentLatency.presented(pacedId, std::chrono::steady_clock::now());
+	else if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+	  swapchainOutdated = true;
+	// timeouts leave the frame unpaced
+      }
+
+      void render()
+      {
+	FrameInFlight &frameInFlight(framesInFlight[currentFrame]);
+
+	if (!assetsReady)
+	  pollUpload();
+
+	if (instancesChanged)
+	  updateInstances();
+	// the frame rendered framesInFlight.size() frames ago has to be done before its resources are reused
+	device.waitForFences({frameInFlight.fence}, true, std::numeric_limits<uint64_t>::max());
+	presentLatency.acquired(presentId);
+	// get next image data, and image to present
+	auto [index, frame] = acquireImage(frameInFlight.imageAvailable);
+
+	// with more frames in flight than swapchain images, another frame may still render to this image
+	if (frame.renderFence)
+	  device.waitForFences({*frame.renderFence}, true, std::numeric_limits<uint64_t>::max());
+	frame.renderFence = magma::Fence<claws::no_delete>(frameInFlight.fence);
+	device.resetFences({frameInFlight.fence});
+	// a static scene costs only the acquire, submit and present
+	if (frame.recordedVersion != sceneVersion)
+	  {
+	    record(frame);
+	    frame.recordedVersion = sceneVersion;
+	  }
 
 	vk::PipelineStageFlags waitDestStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput);
-	queue.submit(magma::StructBuilder<vk::SubmitInfo>::make(asListRef(imageAvailable), // wait fo image to be available
+	queue.submit(magma::StructBuilder<vk::SubmitInfo>::make(magma::asListRef(frameInFlight.imageAvailable), // wait fo image to be available
 								&waitDestStageMask,
-								magma::asListRef(cmdBuffer.raw()),
-								magma::asListRef(renderDone)), // signal renderdone when done
-		     frame.fence); // signal the fence
+								magma::asListRef(frame.commandBuffers[0].raw()),
+								magma::asListRef(frame.renderDone)), // signal renderdone when done
+		     frameInFlight.fence); // signal the fence
 	//std::cout << "about to present for index " << index << std::endl;
-	displaySystem.presentImage(renderDone, index); // present our image
+	present(frame.renderDone, index);
+	if (displayTiming)
+	  collectPresentTimes();
+	++presentId;
+	currentFrame = (currentFrame + 1) % static_cast<unsigned int>(framesInFlight.size());
       }
     };
 
@@ -519,11 +1204,14 @@ namespace display
     Renderer renderer;
 
   public:
+    static constexpr unsigned int DEFAULT_FRAMES_IN_FLIGHT = 2;
+
+    // presentMode falls back to FIFO when the surface doesn't support it or the device has no present wait to pace it
     template<class SurfaceProvider>
-    Display(SurfaceProvider &surfaceProvider)
+    Display(SurfaceProvider &surfaceProvider, unsigned int frameInFlightCount = DEFAULT_FRAMES_IN_FLIGHT, vk::PresentModeKHR presentMode = vk::PresentModeKHR::eFifo)
       : instance{SurfaceProvider::getRequiredExtensions()}
       , surface(surfaceProvider.createSurface(instance))
-      , renderer(instance, surface)
+      , renderer(instance, surface, frameInFlightCount, presentMode)
     {
     }
 
@@ -532,9 +1220,35 @@ namespace display
     Display operator=(Display const &) = delete;
     Display operator=(Display &&) = delete;
 
+    // Waits for the present of the frame rendered framesInFlight frames ago, see Renderer::pace
+    void pace()
+    {
+      renderer.pace();
+    }
+
     void render()
     {
       renderer.render();
     }
+
+    uint32_t addTexture(vk::ImageView imageView)
+    {
+      return renderer.addTexture(imageView);
+    }
+
+    void setSurfaces(std::vector<SurfaceInstance> surfaces)
+    {
+      renderer.setSurfaces(std::move(surfaces));
+    }
+
+    vk::PresentModeKHR getPresentMode() const noexcept
+    {
+      return renderer.getPresentMode();
+    }
+
+    PresentLatency const &getPresentLatency() const noexcept
+    {
+      return renderer.getPresentLatency();
+    }
   };
 }
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <vulkan/vulkan.hpp>
+
+namespace display
+{
+  // Pipeline owning its handle, move only
+  class GraphicsPipeline
+  {
+  public:
+    GraphicsPipeline() = default;
+    GraphicsPipeline(vk::Device device, vk::Pipeline pipeline) noexcept;
+    GraphicsPipeline(GraphicsPipeline const &) = delete;
+    GraphicsPipeline(GraphicsPipeline &&other) noexcept;
+    GraphicsPipeline &operator=(GraphicsPipeline const &) = delete;
+    GraphicsPipeline &operator=(GraphicsPipeline &&other) noexcept;
+    ~GraphicsPipeline();
+
+    operator vk::Pipeline() const noexcept
+    {
+      return pipeline;
+    }
+
+  private:
+    vk::Device device;
+    vk::Pipeline pipeline;
+  };
+
+  /*
+   * VkPipelineCache kept on disk between runs, in $XDG_CACHE_HOME/feathers.
+   * A file written for another device, driver version or pipelineCacheUUID is ignored and replaced at the next save.
+   */
+  class PipelineCache
+  {
+  public:
+    PipelineCache(vk::Device device, vk::PhysicalDevice physicalDevice);
+    PipelineCache(PipelineCache const &) = delete;
+    PipelineCache &operator=(PipelineCache const &) = delete;
+    ~PipelineCache();
+
+    // Throws std::runtime_error when the driver fails to create it
+    GraphicsPipeline createGraphicsPipeline(vk::GraphicsPipelineCreateInfo const &createInfo) const;
+    // Writes what the pipelines created so far added to the cache, failures only cost the next start its compilations
+    void save() const;
+
+    operator vk::PipelineCache() const noexcept
+    {
+      return cache;
+    }
+
+  private:
+    vk::Device device;
+    vk::PhysicalDeviceProperties properties;
+    // empty when there's nowhere to cache
+    std::string path;
+    vk::PipelineCache cache;
+  };
+}
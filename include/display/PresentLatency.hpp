@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <vulkan/vulkan.hpp>
+
+namespace display
+{
+  /*
+   * Time from acquiring a swapchain image to its present reaching the screen, the part of the latency the present mode decides.
+   * Present times come from VK_KHR_present_wait, or VK_GOOGLE_display_timing without it. Frames are told apart by their present id.
+   */
+  class PresentLatency
+  {
+  public:
+    // Percentiles over the last WINDOW samples
+    struct Stats
+    {
+      std::size_t count;
+      std::chrono::nanoseconds min;
+      std::chrono::nanoseconds p50;
+      std::chrono::nanoseconds p90;
+      std::chrono::nanoseconds p99;
+      std::chrono::nanoseconds max;
+    };
+
+    static constexpr std::size_t WINDOW = 600;
+
+    // The image the frame presented as presentId will be drawn to is being acquired now
+    void acquired(uint64_t presentId);
+    // The present of presentId reached the screen at presentTime, frames before it that weren't reported get no sample
+    void presented(uint64_t presentId, std::chrono::steady_clock::time_point presentTime);
+
+    Stats getStats() const;
+    void print(std::ostream &output, vk::PresentModeKHR presentMode) const;
+
+  private:
+    // sanity bound, presents that never complete don't pile up
+    static constexpr std::size_t MAX_PENDING = 64;
+
+    struct Pending
+    {
+      uint64_t presentId;
+      std::chrono::steady_clock::time_point acquireTime;
+    };
+
+    // by increasing present id
+    std::deque<Pending> pending;
+    std::deque<std::chrono::nanoseconds> samples;
+  };
+}
@@ -1,3 +1,5 @@
+#pragma once
+
 namespace display {
   namespace superCorbeau {
     /*  GIMP header image file format (RGB). Arranged a bit by kellen_j*/
@@ -41,6 +43,14 @@ namespace display {
       "DI[/3%B)\\/TM````````````````````````````````````[_PL>H:WIK+CY?(B"
       "````````````^`@XGZO<YO,C_PL[````````````````````````````````````"
       "";
+
+    // Decodes the whole image as RGB888, width * height * 3 bytes
+    inline void decode(unsigned char *rgb) {
+      char const *data(header_data);
+
+      for (unsigned int i(0u); i < width * height; ++i)
+	headerPixel(data, &rgb[i * 3u]);
+    }
   }
 }
 
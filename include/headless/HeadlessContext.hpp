@@ -0,0 +1,48 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <gbm.h>
+#include <EGL/egl.h>
+
+#include "opengl/my_opengl.hpp"
+
+/*
+ * GLES 3 context without any display, rendering into an offscreen framebuffer.
+ * Uses the first render node through gbm, or Mesa's surfaceless platform
+ * (llvmpipe when there is no GPU at all), so the renderer can run in CI.
+ */
+class HeadlessContext
+{
+public:
+  HeadlessContext(uint32_t width, uint32_t height);
+  HeadlessContext(HeadlessContext const &) = delete;
+  HeadlessContext &operator=(HeadlessContext const &) = delete;
+  ~HeadlessContext();
+
+  // Binds the offscreen framebuffer and sets the viewport
+  void makeCurrent();
+
+  // Render node or platform the context runs on, and the GL renderer string
+  std::string const &getDevice() const;
+  std::string getRenderer() const;
+  uint32_t getWidth() const;
+  uint32_t getHeight() const;
+
+private:
+  bool initRenderNode();
+  bool initSurfaceless();
+  void createContext();
+
+  int fd;
+  struct gbm_device *gbmDevice;
+  EGLDisplay eglDisplay;
+  EGLContext eglContext;
+  std::string device;
+  uint32_t width;
+  uint32_t height;
+
+  // created once the context is current
+  std::unique_ptr<Texture> colorBuffer;
+  std::unique_ptr<Framebuffer> framebuffer;
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+namespace drmProperty
+{
+  // Looks up a property id by name on a drm object, throws ModeSettingError if it doesn't exist
+  uint32_t getId(int fd, uint32_t objectId, uint32_t objectType, char const *name);
+  // Same as getId for optional properties, 0 if it doesn't exist
+  uint32_t findId(int fd, uint32_t objectId, uint32_t objectType, char const *name);
+  // Current value of a property, 0 if the object doesn't have it
+  uint64_t getValue(int fd, uint32_t objectId, uint32_t objectType, char const *name);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * CPU mapped scanout buffer allocated with DRM_IOCTL_MODE_CREATE_DUMB, with its framebuffer.
+ * Works on every KMS driver, including vkms, without a GPU.
+ */
+class DumbBuffer
+{
+public:
+  DumbBuffer(int fd, uint32_t width, uint32_t height, uint32_t format);
+  DumbBuffer(DumbBuffer const &) = delete;
+  DumbBuffer &operator=(DumbBuffer const &) = delete;
+  ~DumbBuffer();
+
+  uint32_t getFb() const;
+  uint32_t getWidth() const;
+  uint32_t getHeight() const;
+  // Bytes per row
+  uint32_t getStride() const;
+  void *getPixels() const;
+
+private:
+  int fd;
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride;
+  uint32_t handle;
+  uint64_t size;
+  uint32_t fb;
+  void *pixels;
+};
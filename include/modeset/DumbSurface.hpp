@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <memory>
+
+#include "modeset/ScanoutSurface.hpp"
+#include "modeset/DumbBuffer.hpp"
+
+/*
+ * Two XRGB8888 dumb buffers the software renderer draws into, flipped in turn
+ */
+class DumbSurface : public ScanoutSurface
+{
+public:
+  DumbSurface(int fd, uint32_t width, uint32_t height);
+  DumbSurface(DumbSurface const &) = delete;
+  DumbSurface &operator=(DumbSurface const &) = delete;
+  ~DumbSurface() override = default;
+
+  // Buffer that isn't on screen, only valid to draw into while no flip is pending
+  DumbBuffer &getBackBuffer();
+
+  unsigned int getBufferAge() override;
+  void beginFrame(pixel::Region const &repaint) override;
+  uint32_t lockFrontBuffer(pixel::Region const &damage) override;
+  void releasePendingBuffer() override;
+  void onPageFlip() override;
+  unsigned int getAddFbCount() const override;
+
+private:
+  static constexpr int NONE = -1;
+
+  std::array<std::unique_ptr<DumbBuffer>, 2u> buffers;
+  // buffer currently scanned out
+  int front;
+  // buffer queued for the next vblank
+  int pending;
+  // frame each buffer was last drawn in, 0 if never
+  std::array<unsigned int, 2u> bufferFrames;
+  unsigned int frameCount;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+
+/*
+ * Decides when an output should render its next frame.
+ * Rendering starts as late as possible before the next vblank, based on the
+ * vblank timestamps reported by page flips and a rolling history of render times.
+ * Nothing is rendered until a repaint is scheduled.
+ */
+class FrameScheduler
+{
+public:
+  // drm page flip timestamps are CLOCK_MONOTONIC, like steady_clock on linux
+  using Clock = std::chrono::steady_clock;
+
+  explicit FrameScheduler(std::chrono::nanoseconds refreshPeriod);
+
+  // Something on the output changed, a frame has to be rendered
+  void scheduleRepaint();
+  bool isRepaintScheduled() const;
+
+  // Time at which rendering should start to hit the next reachable vblank, Clock::time_point::max() when idle
+  Clock::time_point getRenderStart(Clock::time_point now) const;
+  // To be called around the render and swap of a frame
+  void onRenderStart(Clock::time_point now);
+  void onRenderEnd(Clock::time_point now);
+  // Timestamp of the vblank at which the last frame was shown
+  void onPageFlip(Clock::time_point vblank);
+
+  std::chrono::nanoseconds predictRenderTime() const;
+  std::chrono::nanoseconds getRefreshPeriod() const;
+  unsigned int getMissedFrameCount() const;
+
+private:
+  static constexpr std::size_t HISTORY_SIZE = 32;
+
+  Clock::time_point getNextVblank(Clock::time_point now) const;
+
+  std::chrono::nanoseconds refreshPeriod;
+  std::array<std::chrono::nanoseconds, HISTORY_SIZE> history;
+  std::size_t historyIndex;
+  std::size_t historyCount;
+  // extra slack before the vblank, grows when frames miss their vblank
+  std::chrono::nanoseconds safetyMargin;
+  Clock::time_point lastVblank;
+  Clock::time_point renderStart;
+  Clock::time_point targetVblank;
+  bool repaintScheduled;
+  bool frameInFlight;
+  unsigned int missedFrameCount;
+};
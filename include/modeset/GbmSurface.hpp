@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <gbm.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "modeset/ScanoutSurface.hpp"
+
+/*
+ * gbm_surface wrapped in an EGLSurface, rendered to with GL
+ * When the primary plane lists modifiers, the driver picks a tiled or compressed layout among them
+ * instead of the linear one, which saves memory bandwidth on every frame.
+ */
+class GbmSurface : public ScanoutSurface
+{
+public:
+  // modifiers are the ones the primary plane scans out, empty to let the driver choose implicitly
+  GbmSurface(int fd, struct gbm_device *gbmDevice, EGLDisplay eglDisplay, EGLConfig eglConfig,
+	     uint32_t width, uint32_t height, std::vector<uint64_t> const &modifiers);
+  GbmSurface(GbmSurface const &) = delete;
+  GbmSurface &operator=(GbmSurface const &) = delete;
+  ~GbmSurface() override;
+
+  // Binds this surface to the shared context and sets the viewport
+  void makeCurrent(EGLContext eglContext);
+
+  unsigned int getBufferAge() override;
+  void beginFrame(pixel::Region const &repaint) override;
+  uint32_t lockFrontBuffer(pixel::Region const &damage) override;
+  void releasePendingBuffer() override;
+  void onPageFlip() override;
+  unsigned int getAddFbCount() const override;
+  // Layout of the buffers, DRM_FORMAT_MOD_INVALID when it was chosen implicitly
+  uint64_t getModifier() const;
+
+private:
+  // Framebuffer attached to a gbm_bo as user data, removed with the bo
+  struct BoFramebuffer
+  {
+    int fd;
+    uint32_t fbId;
+  };
+
+  // EGL rectangles are x, y, width, height from the bottom left corner
+  std::vector<EGLint> toEglRects(pixel::Region const &region) const;
+  static void destroyBoFramebuffer(struct gbm_bo *bo, void *data);
+  uint32_t getFramebuffer(struct gbm_bo *bo);
+
+  int fd;
+  EGLDisplay eglDisplay;
+  uint32_t width;
+  uint32_t height;
+  struct gbm_surface *gbmSurface;
+  EGLSurface eglSurface;
+  // the buffers were allocated from a modifier list, framebuffers must carry the modifier
+  bool explicitModifiers;
+  uint64_t modifier;
+
+  // optional extensions, null when missing
+  bool hasBufferAge;
+  PFNEGLSETDAMAGEREGIONKHRPROC setDamageRegion;
+  PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC swapBuffersWithDamage;
+
+  // buffer currently scanned out
+  struct gbm_bo *currentBo;
+  // buffer queued for the next vblank
+  struct gbm_bo *pendingBo;
+  unsigned int addFbCount;
+};
@@ -1,49 +1,79 @@
 #pragma once
 
+#include <memory>
+#include <optional>
+#include <vector>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include <gbm.h>
 #include <EGL/egl.h>
 #include <GL/gl.h>
 
+#include "modeset/Output.hpp"
+#include "modeset/PlaneAllocator.hpp"
+
 /*
  * Class that handles kernel mode setting
+ * Every connected connector gets its own Output.
+ * With the GL backend all of them share one EGL context so textures and programs are only created once,
+ * the software backend scans out dumb buffers and needs neither gbm nor EGL.
  */
 class ModeSetter
 {
+public:
+  enum class Backend
+    {
+      Gl,
+      Software
+    };
+
+private:
+  // owns the card fd, closed after everything else using it is destroyed
   struct Drm
   {
-    Drm();
+    Drm(Backend backend);
+    Drm(Drm const &) = delete;
+    Drm &operator=(Drm const &) = delete;
+    ~Drm();
 
     int fd;
-    uint32_t connectorId;
-    drmModeModeInfo modeInfo;
-    drmModeCrtc *crtc;
   };
 
   struct Gbm
   {
-    Gbm(int fd, uint16_t width, uint16_t height);
+    Gbm(int fd);
 
     struct gbm_device *gbmDevice;
-    struct gbm_surface *gbmSurface;
     EGLDisplay eglDisplay;
+    EGLConfig eglConfig;
     EGLContext eglContext;
-    EGLSurface eglSurface;
   };
 
 public:
-  ModeSetter();
+  ModeSetter(Backend backend = Backend::Gl);
+  ModeSetter(ModeSetter const &) = delete;
+  ModeSetter &operator=(ModeSetter const &) = delete;
   ~ModeSetter();
 
-  void swapBuffers();
-  int getScreenWidth() const;
-  int getScreenHeight() const;
+  // Binds the output's surface to the shared context, GL backend only
+  void makeCurrent(Output &output);
+  // Dispatches the pending drm events, call when the drm fd is readable
+  void handleEvents();
+  // Blocks until every pending commit completes, frames and cursor updates
+  void waitPageFlips();
+
+  Backend getBackend() const;
+  int getFd() const;
+  std::vector<std::unique_ptr<Output>> const &getOutputs() const;
 
 private:
-  Drm drm;
-  Gbm gbm;
+  static void pageFlipHandler(int fd, unsigned int sequence, unsigned int sec, unsigned int usec, void *data);
+  void createOutputs();
 
-  struct gbm_bo *previousBo;
-  uint32_t previousFb;
+  Backend backend;
+  Drm drm;
+  // only for the GL backend
+  std::optional<Gbm> gbm;
+  PlaneAllocator planeAllocator;
+  std::vector<std::unique_ptr<Output>> outputs;
 };
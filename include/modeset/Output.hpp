@@ -0,0 +1,160 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "modeset/PlaneAllocator.hpp"
+#include "modeset/FrameScheduler.hpp"
+#include "modeset/ScanoutSurface.hpp"
+#include "modeset/DumbBuffer.hpp"
+#include "pixel/Region.hpp"
+
+/*
+ * One connector driven by its own crtc, with its own scanout surface and page flip state.
+ * Outputs flip independently, each on its own vblank.
+ * The cursor is put on a hardware plane when the kernel accepts it, otherwise it has to be composited.
+ */
+class Output
+{
+public:
+  // Timestamp reported by the kernel when a flip hit the screen
+  struct PageFlip
+  {
+    unsigned int sequence;
+    unsigned int sec;
+    unsigned int usec;
+  };
+
+  // Creates the buffers for the selected mode, scanned out on the primary plane
+  using SurfaceFactory = std::function<std::unique_ptr<ScanoutSurface> (uint32_t width,
+									uint32_t height,
+									PlaneAllocator::Plane const &primaryPlane)>;
+
+  Output(int fd,
+	 drmModeConnector const &connector,
+	 uint32_t crtcId,
+	 int crtcIndex,
+	 PlaneAllocator &planeAllocator,
+	 PlaneAllocator::Plane &primaryPlane,
+	 SurfaceFactory const &createSurface);
+  Output(Output const &) = delete;
+  Output(Output &&) = delete;
+  Output &operator=(Output const &) = delete;
+  Output &operator=(Output &&) = delete;
+  ~Output();
+
+  ScanoutSurface &getSurface();
+  // Marks part of the screen as changed and schedules a repaint
+  void addDamage(pixel::Rect const &rect);
+  void damageAll();
+  // Starts a frame, once the surface is current. Returns the part of the back buffer to repaint:
+  // the damage of this frame plus whatever changed since the back buffer was last drawn.
+  pixel::Region beginFrame();
+  // Queues a non blocking flip to the last rendered buffer, right away or once the cursor commit in flight completes.
+  // Must not be called while a flip is pending.
+  void swapBuffers();
+  // Called by the drm event handler once the queued flip completed
+  void onPageFlip(PageFlip const &pageFlip);
+
+  // Sets the cursor image (ARGB8888, at most the hardware cursor size) and puts it on a cursor plane
+  void setCursorImage(uint32_t const *argb, uint32_t width, uint32_t height);
+  // Moving a cursor on a plane only commits its new position, no frame is rendered
+  void moveCursor(int32_t x, int32_t y);
+  void hideCursor();
+  // False when no plane could take the cursor and it has to be composited
+  bool isCursorOnPlane() const;
+  bool isCursorVisible() const;
+  // Cursor image and on-screen rectangle, for composition
+  std::vector<uint32_t> const &getCursorImage() const;
+  PlaneAllocator::Rect getCursorRect() const;
+
+  // A frame is queued or on its way to the screen, the next one can't be rendered yet
+  bool isPageFlipPending() const;
+  // Any commit, frame or cursor only, hasn't completed yet
+  bool isCommitPending() const;
+  PageFlip const &getLastPageFlip() const;
+  unsigned int getPageFlipCount() const;
+  // Number of drmModeAddFB calls, stays constant once every buffer got its framebuffer
+  unsigned int getAddFbCount() const;
+  FrameScheduler &getFrameScheduler();
+  uint32_t getConnectorId() const;
+  uint32_t getCrtcId() const;
+  int getWidth() const;
+  int getHeight() const;
+
+private:
+  // A buffer scanned out directly on a plane instead of being composited
+  struct Layer
+  {
+    PlaneAllocator::Plane *plane;
+    uint32_t fb;
+    PlaneAllocator::Rect src;
+    PlaneAllocator::Rect dst;
+    bool visible;
+    // the plane configuration changed and must be validated with a test commit
+    bool changed;
+    // only the position changed
+    bool moved;
+    // the kernel refused the plane configuration, the caller composites it
+    bool composited;
+  };
+
+  // Commits the layers, and the primary plane when fb isn't 0. Nothing is committed when nothing changed.
+  void commit(uint32_t fb, pixel::Region const *damage = nullptr);
+  // Gives back the buffer of a frame that couldn't be committed and repaints everything
+  void dropFrame();
+  pixel::Rect getScreenRect() const;
+  // Damages the cursor area when the cursor is composited
+  void damageCursor();
+  // Returns whether the layer added anything to the request
+  bool addLayer(drmModeAtomicReq *req, Layer &layer, uint32_t flags);
+  void reserveLayerPlane(Layer &layer, PlaneAllocator::Type type, uint32_t format);
+
+  int fd;
+  uint32_t connectorId;
+  uint32_t crtcId;
+  int crtcIndex;
+  PlaneAllocator &planeAllocator;
+  PlaneAllocator::Plane &primaryPlane;
+  drmModeModeInfo modeInfo;
+  // crtc state before we took over, restored on destruction
+  drmModeCrtc *savedCrtc;
+  uint32_t modeBlobId;
+  bool modeSet;
+
+  // atomic property ids, looked up once
+  struct
+  {
+    uint32_t crtcId;
+  } connectorProperties;
+  struct
+  {
+    uint32_t modeId;
+    uint32_t active;
+  } crtcProperties;
+
+  std::unique_ptr<ScanoutSurface> surface;
+  // a commit was queued and its flip event hasn't arrived yet
+  bool commitPending;
+  // the commit in flight carries a frame, not only cursor updates
+  bool frameCommitted;
+  // frame rendered while a cursor commit was in flight, committed from its flip event
+  uint32_t queuedFb;
+  pixel::Region queuedDamage;
+
+  Layer cursor;
+  std::unique_ptr<DumbBuffer> cursorBuffer;
+  std::vector<uint32_t> cursorImage;
+
+  // damage since the last frame, and of the previous frames, most recent first
+  pixel::Region damage;
+  std::deque<pixel::Region> damageHistory;
+
+  FrameScheduler frameScheduler;
+  PageFlip lastPageFlip;
+  unsigned int pageFlipCount;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+/*
+ * Enumerates the primary, overlay and cursor planes of a drm device
+ * and hands them out to the crtcs that can use them.
+ */
+class PlaneAllocator
+{
+public:
+  enum class Type : uint64_t
+    {
+      Overlay = DRM_PLANE_TYPE_OVERLAY,
+      Primary = DRM_PLANE_TYPE_PRIMARY,
+      Cursor = DRM_PLANE_TYPE_CURSOR
+    };
+
+  struct Rect
+  {
+    int32_t x;
+    int32_t y;
+    uint32_t width;
+    uint32_t height;
+  };
+
+  struct Plane
+  {
+    uint32_t id;
+    Type type;
+    uint32_t possibleCrtcs;
+    std::vector<uint32_t> formats;
+    // format and modifier pairs from IN_FORMATS, empty when the driver doesn't expose it
+    std::vector<std::pair<uint32_t, uint64_t>> formatModifiers;
+    // crtc the plane is reserved for, 0 when free
+    uint32_t crtcId;
+
+    // atomic property ids, looked up once
+    struct
+    {
+      uint32_t fbId;
+      uint32_t crtcId;
+      uint32_t srcX;
+      uint32_t srcY;
+      uint32_t srcW;
+      uint32_t srcH;
+      uint32_t crtcX;
+      uint32_t crtcY;
+      uint32_t crtcW;
+      uint32_t crtcH;
+      // 0 when the driver doesn't take damage hints
+      uint32_t fbDamageClips;
+    } properties;
+
+    bool supportsFormat(uint32_t format) const;
+    // Modifiers the plane can scan out with this format, empty if only implicit modifiers work
+    std::vector<uint64_t> getModifiers(uint32_t format) const;
+    // Adds the properties scanning out `fb` to the request, `src` is in buffer pixels
+    void set(drmModeAtomicReq *req, uint32_t crtcId, uint32_t fb, Rect const &src, Rect const &dst) const;
+    // Only updates the on-screen position, for cursor moves
+    void move(drmModeAtomicReq *req, int32_t x, int32_t y) const;
+    void disable(drmModeAtomicReq *req) const;
+    // Tells the driver which part of the new framebuffer changed, blobId holds drm_mode_rects
+    void setDamage(drmModeAtomicReq *req, uint32_t blobId) const;
+  };
+
+  explicit PlaneAllocator(int fd);
+  PlaneAllocator(PlaneAllocator const &) = delete;
+  PlaneAllocator &operator=(PlaneAllocator const &) = delete;
+  ~PlaneAllocator() = default;
+
+  // Reserves a free plane of the given type usable on the crtc, nullptr if there is none
+  Plane *reserve(Type type, uint32_t crtcId, int crtcIndex, uint32_t format);
+  void release(Plane *plane);
+  // Checks with the kernel that the request would succeed, without applying it
+  bool test(drmModeAtomicReq *req, uint32_t flags) const;
+
+private:
+  int fd;
+  std::vector<Plane> planes;
+};
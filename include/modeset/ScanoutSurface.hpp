@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+#include "pixel/Region.hpp"
+
+/*
+ * Set of buffers an Output renders into and scans out.
+ * Implemented on top of gbm/EGL for the GL renderer and on dumb buffers for the software renderer.
+ */
+class ScanoutSurface
+{
+public:
+  virtual ~ScanoutSurface() = default;
+
+  // Number of frames since the back buffer was drawn, 0 when its content is undefined
+  virtual unsigned int getBufferAge() = 0;
+  // Called before drawing with the part of the back buffer that will be repainted
+  virtual void beginFrame(pixel::Region const &repaint) = 0;
+  // Returns the framebuffer of the frame that was just rendered, it becomes the pending buffer.
+  // damage is the part that changed since the previous frame.
+  virtual uint32_t lockFrontBuffer(pixel::Region const &damage) = 0;
+  // The pending buffer couldn't be queued for scanout
+  virtual void releasePendingBuffer() = 0;
+  // The pending buffer reached the screen, the previous one can be reused
+  virtual void onPageFlip() = 0;
+  // Number of drmModeAddFB calls, stays constant once every buffer got its framebuffer
+  virtual unsigned int getAddFbCount() const = 0;
+};
@@ -0,0 +1,85 @@
+#ifndef DMABUFIMPORTER_HPP_
+# define DMABUFIMPORTER_HPP_
+
+# include <array>
+# include <cstdint>
+# include <map>
+# include <sys/types.h>
+# include <EGL/egl.h>
+# include <EGL/eglext.h>
+# include "my_opengl.hpp"
+# include "GlState.hpp"
+# include <GLES2/gl2ext.h>
+
+// Linux dmabuf as sent by clients or video decoders, up to 4 planes
+struct Dmabuf
+{
+  uint32_t width;
+  uint32_t height;
+  // drm fourcc
+  uint32_t format;
+  // DRM_FORMAT_MOD_INVALID when the layout is implicit
+  uint64_t modifier;
+  unsigned int planeCount;
+  std::array<int, 4u> fds;
+  std::array<uint32_t, 4u> offsets;
+  std::array<uint32_t, 4u> strides;
+};
+
+/*
+ * Wraps dmabufs in GL_TEXTURE_EXTERNAL_OES textures through EGL_EXT_image_dma_buf_import,
+ * the GPU samples the buffer where it is, without any copy.
+ * Clients cycle through a few buffers, so each one is imported once and its texture reused
+ * until the buffer is released.
+ */
+class DmabufImporter
+{
+public:
+  // Uses the current EGL display, textures are bound through state which must outlive the importer
+  explicit DmabufImporter(GlState &state);
+  DmabufImporter(DmabufImporter const &) = delete;
+  DmabufImporter &operator=(DmabufImporter const &) = delete;
+  ~DmabufImporter();
+
+  bool isSupported() const;
+  // The texture belongs to the importer until the buffer is released
+  GLuint import(Dmabuf const &dmabuf);
+  // Forgets a buffer and deletes its texture, call it when the client destroys it
+  void release(Dmabuf const &dmabuf);
+  // EGLImages created so far, stays constant once every buffer of a client got one
+  unsigned int getImportCount() const;
+
+private:
+  // The dmabuf inode identifies the buffer whatever fd number the client used
+  struct Key
+  {
+    dev_t device;
+    ino_t inode;
+    uint32_t format;
+    uint64_t modifier;
+
+    bool operator<(Key const &other) const;
+  };
+
+  struct Entry
+  {
+    // keeps the buffer, and thus its inode, alive while it is cached
+    int fd;
+    EGLImageKHR image;
+    Texture texture;
+  };
+
+  Key getKey(Dmabuf const &dmabuf) const;
+  EGLImageKHR createImage(Dmabuf const &dmabuf) const;
+
+  GlState &state;
+  EGLDisplay eglDisplay;
+  bool hasModifiers;
+  PFNEGLCREATEIMAGEKHRPROC eglCreateImage;
+  PFNEGLDESTROYIMAGEKHRPROC eglDestroyImage;
+  PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2D;
+  std::map<Key, Entry> cache;
+  unsigned int importCount;
+};
+
+#endif /* !DMABUFIMPORTER_HPP_ */
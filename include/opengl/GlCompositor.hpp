@@ -0,0 +1,79 @@
+#ifndef GLCOMPOSITOR_HPP_
+# define GLCOMPOSITOR_HPP_
+
+# include <cstdint>
+# include <vector>
+# include "GpuProfiler.hpp"
+# include "SurfaceRenderer.hpp"
+# include "pixel/Region.hpp"
+
+/*
+ * Composes the desktop with GL: the background and the windows stacked on it.
+ * Surfaces hidden by opaque ones in front of them are skipped, partly hidden ones are clipped to what shows.
+ */
+class GlCompositor
+{
+public:
+  // Windows stacked on the background to load the renderer, they show the background image
+  struct Scene
+  {
+    unsigned int windowCount;
+    // full opacity, the windows hide what's under them
+    bool opaqueWindows;
+    // an opaque window covering the whole screen under the others
+    bool maximizedWindow;
+  };
+
+  explicit GlCompositor(Scene const &scene = {0, false, false});
+
+  // Cursor drawn over the windows, for when no plane could take it. argb holds premultiplied ARGB8888 pixels
+  // like Output::getCursorImage, width * height of them, null hides the cursor. Only a new image is uploaded.
+  void setCursor(uint32_t const *argb, pixel::Rect const &rect);
+  // Repaints part of the current framebuffer, each rectangle of the region is scissored.
+  // The GPU time of the whole repaint and of each rectangle go to the "compose" and "rect" profiler spans.
+  void draw(uint32_t width, uint32_t height, pixel::Region const &repaint);
+  // Draw calls issued by the last draw
+  unsigned int getDrawCallCount() const;
+  // Surfaces the last draw skipped in a repainted rectangle because opaque ones hide them there
+  unsigned int getCulledCount() const;
+  GlState const &getState();
+  GpuProfiler &getProfiler();
+
+private:
+  struct Layer
+  {
+    SurfaceRenderer::Surface surface;
+    // part that hides what's under the surface at full opacity, in pixels from its top left corner
+    pixel::Region opaqueRegion;
+  };
+
+  void layout(uint32_t width, uint32_t height);
+  // Adds what shows of the layer in rect to visibleSurfaces, or counts it as culled, then adds its opaque parts to the occluders
+  void addVisibleParts(Layer const &layer, pixel::Rect const &rect);
+
+  SurfaceRenderer renderer;
+  GpuProfiler profiler;
+  uint32_t imageWidth;
+  uint32_t imageHeight;
+  bool imageTopRowFirst;
+  SurfaceRenderer::TextureSlot image;
+  Scene scene;
+  // size the surfaces were laid out for
+  uint32_t width;
+  uint32_t height;
+  // back to front
+  std::vector<Layer> layers;
+  // in front of the layers when cursorVisible
+  Layer cursor;
+  bool cursorVisible;
+  // ARGB8888 pixels in cursor's texture, whose size is 0 until the first image
+  std::vector<uint32_t> cursorImage;
+  // opaque parts of the surfaces already visited in the rectangle being repainted, front to back
+  std::vector<pixel::Rect> occluders;
+  // parts of the surfaces showing in the rectangle being repainted
+  std::vector<SurfaceRenderer::Surface> visibleSurfaces;
+  unsigned int drawCallCount;
+  unsigned int culledCount;
+};
+
+#endif /* !GLCOMPOSITOR_HPP_ */
@@ -0,0 +1,76 @@
+#ifndef GLSTATE_HPP_
+# define GLSTATE_HPP_
+
+# include <array>
+# include <cstddef>
+# include <optional>
+# include <tuple>
+# include <GLES3/gl3.h>
+
+/*
+ * Shadow of the GL state the renderer changes every frame: program, vertex array, textures,
+ * blending and scissor. A call setting what is already set is skipped.
+ * Code changing these behind its back has to call invalidate.
+ */
+class GlState
+{
+public:
+  // Texture units whose bindings are shadowed, bindings to other units are always issued
+  static constexpr GLuint UNIT_COUNT = 8;
+
+  GlState() = default;
+  GlState(GlState const &) = delete;
+  GlState &operator=(GlState const &) = delete;
+
+  void useProgram(GLuint program);
+  void bindVertexArray(GLuint vao);
+  // Only GL_ARRAY_BUFFER is shadowed
+  void bindBuffer(GLenum target, GLuint buffer);
+  // Selects unit then binds texture to target on it
+  void bindTexture(GLuint unit, GLenum target, GLuint texture);
+  // Only GL_BLEND and GL_SCISSOR_TEST are shadowed
+  void setEnabled(GLenum capability, bool enabled);
+  void blendFunc(GLenum source, GLenum destination);
+  void scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+
+  // Call before deleting a texture, GL unbinds it and its name can be handed out again
+  void forgetTexture(GLuint texture);
+  // Forgets everything, the next calls are all issued
+  void invalidate();
+
+  // GL calls issued and skipped since the state was created
+  unsigned long getCallCount() const;
+  unsigned long getElidedCallCount() const;
+
+private:
+  // texture targets, GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY and GL_TEXTURE_EXTERNAL_OES
+  static constexpr std::size_t TARGET_COUNT = 3;
+
+  // Records value, true when the call has to be issued
+  template<class T>
+  bool update(std::optional<T> &shadow, T const &value)
+  {
+    if (shadow == value)
+      {
+	++elidedCallCount;
+	return false;
+      }
+    shadow = value;
+    ++callCount;
+    return true;
+  }
+
+  std::optional<GLuint> program;
+  std::optional<GLuint> vao;
+  std::optional<GLuint> arrayBuffer;
+  std::optional<GLuint> activeUnit;
+  std::array<std::array<std::optional<GLuint>, TARGET_COUNT>, UNIT_COUNT> textures;
+  std::optional<bool> blend;
+  std::optional<bool> scissorTest;
+  std::optional<std::tuple<GLenum, GLenum>> blendFactors;
+  std::optional<std::tuple<GLint, GLint, GLsizei, GLsizei>> scissorBox;
+  unsigned long callCount = 0;
+  unsigned long elidedCallCount = 0;
+};
+
+#endif /* !GLSTATE_HPP_ */
@@ -0,0 +1,122 @@
+#ifndef GPUPROFILER_HPP_
+# define GPUPROFILER_HPP_
+
+# include <array>
+# include <chrono>
+# include <cstdint>
+# include <deque>
+# include <map>
+# include <ostream>
+# include <string>
+# include <vector>
+# include <GLES3/gl3.h>
+# include <GLES2/gl2ext.h>
+
+/*
+ * Times named spans of GPU work (render passes, per output composition...) with GL_EXT_disjoint_timer_query
+ * timestamps. Spans may nest. Results are read a few frames later from a ring of queries, never stalling
+ * unless more spans are in flight than the ring holds.
+ * Keeps rolling percentiles per span name and the last spans for a Chrome trace (chrome://tracing, Perfetto).
+ */
+class GpuProfiler
+{
+public:
+  // Percentiles over the last WINDOW samples of a span name
+  struct Stats
+  {
+    std::size_t count;
+    std::chrono::nanoseconds min;
+    std::chrono::nanoseconds p50;
+    std::chrono::nanoseconds p90;
+    std::chrono::nanoseconds p99;
+    std::chrono::nanoseconds max;
+  };
+
+  // Times the enclosing block
+  class Scope
+  {
+  public:
+    Scope(GpuProfiler &profiler, char const *name);
+    ~Scope();
+    Scope(Scope const &) = delete;
+    Scope &operator=(Scope const &) = delete;
+
+  private:
+    GpuProfiler &profiler;
+  };
+
+  static constexpr std::size_t WINDOW = 600;
+  static constexpr std::size_t TRACE_SPANS = 4096;
+
+  GpuProfiler();
+  ~GpuProfiler();
+  GpuProfiler(GpuProfiler const &) = delete;
+  GpuProfiler &operator=(GpuProfiler const &) = delete;
+
+  // Without timestamp queries every call is a no-op and there are no results
+  bool isSupported() const;
+
+  // name has to outlive the profiler, e.g. a string literal
+  void begin(char const *name);
+  void end();
+  // Reads the spans the GPU finished, call once per frame. With wait, blocks until all have finished.
+  void collect(bool wait = false);
+  // Forgets the samples and the trace collected so far, e.g. of warm-up frames
+  void clear();
+
+  Stats getStats(std::string const &name) const;
+  // One line of percentiles per span name
+  void print(std::ostream &output) const;
+  // Chrome trace event JSON of the last TRACE_SPANS spans
+  void writeTrace(std::ostream &output) const;
+  bool writeTrace(std::string const &path) const;
+  // Spans whose query had to be waited for because the ring was full
+  unsigned int getStallCount() const;
+
+  // Async signal safe, asks the profilers to write a trace at their next collect (see main.cpp, SIGUSR1)
+  static void requestTrace();
+
+private:
+  static constexpr unsigned int QUERY_COUNT = 512;
+
+  struct Span
+  {
+    char const *name;
+    unsigned int depth;
+    uint64_t begin;
+    uint64_t end;
+    // timestamps read back so far, 2 once the span is finished
+    unsigned int readCount;
+    // end was called, its end timestamp is in flight
+    bool ended;
+  };
+
+  // Span a query belongs to, ids count every span ever begun
+  struct QueryOwner
+  {
+    std::size_t span;
+    bool isEnd;
+  };
+
+  void issueTimestamp(std::size_t span, bool isEnd);
+  // Reads the oldest query into its span, returns false if it isn't available and wait is false
+  bool readOldestQuery(bool wait);
+
+  PFNGLQUERYCOUNTEREXTPROC queryCounter;
+  PFNGLGETQUERYOBJECTUI64VEXTPROC getQueryObjectui64v;
+  std::array<GLuint, QUERY_COUNT> queries;
+  std::array<QueryOwner, QUERY_COUNT> owners;
+  // queries in flight are first to first + used - 1, modulo QUERY_COUNT
+  unsigned int first;
+  unsigned int used;
+  // spans not read back yet in begin order, the first one has id firstSpan
+  std::deque<Span> spans;
+  std::size_t firstSpan;
+  // ids of the spans begun and not ended yet, innermost last
+  std::vector<std::size_t> openSpans;
+  std::map<std::string, std::deque<std::chrono::nanoseconds>> samples;
+  std::deque<Span> trace;
+  unsigned int stallCount;
+};
+
+#endif /* !GPUPROFILER_HPP_ */
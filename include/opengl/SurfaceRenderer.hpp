@@ -0,0 +1,129 @@
+#ifndef SURFACERENDERER_HPP_
+# define SURFACERENDERER_HPP_
+
+# include <array>
+# include <cstdint>
+# include <vector>
+# include "my_opengl.hpp"
+# include "GlState.hpp"
+# include "TextureUploader.hpp"
+# include "pixel/Region.hpp"
+
+/*
+ * Draws textured quads (windows, backgrounds, cursors) with instancing.
+ * Small textures are layers of a few texture arrays bucketed by power of two size, larger ones get arrays of
+ * their exact size. Consecutive surfaces whose textures share an array are drawn with a single call.
+ * Imported buffers (dmabufs) can't be layers, each one is drawn with its own call.
+ */
+class SurfaceRenderer
+{
+public:
+  // Layer of a texture array holding the pixels of one surface
+  struct TextureSlot
+  {
+    unsigned int array;
+    unsigned int layer;
+    uint32_t width;
+    uint32_t height;
+  };
+
+  struct Surface
+  {
+    TextureSlot texture;
+    // on screen, in pixels from the top left corner
+    float x;
+    float y;
+    float width;
+    float height;
+    // part of the texture shown, in texture pixels, a negative height flips the image
+    float srcX;
+    float srcY;
+    float srcWidth;
+    float srcHeight;
+    float opacity;
+    // ignore the texture alpha, for buffers without one
+    bool opaque;
+  };
+
+  SurfaceRenderer();
+  SurfaceRenderer(SurfaceRenderer const &) = delete;
+  SurfaceRenderer &operator=(SurfaceRenderer const &) = delete;
+  ~SurfaceRenderer() = default;
+
+  // Uploads premultiplied RGBA pixels, rows in increasing texture v order
+  TextureSlot createTexture(uint32_t width, uint32_t height, void const *rgba);
+  void updateTexture(TextureSlot const &slot, void const *rgba);
+  // Uploads only rect, pixels points to the first row of the whole buffer, stride bytes apart
+  void updateTexture(TextureSlot const &slot, pixel::Rect const &rect, void const *pixels, std::size_t stride);
+  // Uploads RGBA8 texels in their own texture, sampled through swizzle (GL_TEXTURE_SWIZZLE_R to A),
+  // for images whose bytes aren't in RGBA order. It is drawn with its own call.
+  TextureSlot createTexture(uint32_t width, uint32_t height, void const *pixels, std::array<GLint, 4u> const &swizzle);
+  // Uploads a compressed image (ETC2, ASTC...) in its own texture, it is drawn with its own call
+  TextureSlot createCompressedTexture(GLenum format, uint32_t width, uint32_t height, void const *data, std::size_t size);
+  // Registers a GL_TEXTURE_EXTERNAL_OES texture, e.g. an imported dmabuf, it has to outlive the slot
+  TextureSlot addExternalTexture(GLuint texture, uint32_t width, uint32_t height);
+  void destroyTexture(TextureSlot const &slot);
+
+  // Draws the surfaces back to front in the current framebuffer
+  void draw(std::vector<Surface> const &surfaces, uint32_t viewportWidth, uint32_t viewportHeight);
+  // Draw calls issued by the last draw
+  unsigned int getDrawCallCount() const;
+  // Bindings are left in place after a draw, code sharing the context goes through this state
+  GlState &getState();
+
+private:
+  struct TextureArray
+  {
+    uint32_t width;
+    uint32_t height;
+    GLenum format;
+    unsigned int capacity;
+    Texture texture;
+    std::vector<unsigned int> freeLayers;
+    // a single image with its own sampling (compressed, swizzled), unused once its size is 0
+    bool dedicated;
+    // a single texture owned by its importer, unused once its size is 0
+    bool external;
+    GLuint externalTexture;
+  };
+
+  // Per instance vertex data, see shaders/surface.vert
+  struct Instance
+  {
+    float dst[4];
+    float src[4];
+    float layer;
+    float opacity;
+    float opaque;
+  };
+
+  static constexpr unsigned int INITIAL_LAYERS = 1;
+  // textures up to this size share power of two buckets, padding a larger one would cost too much memory
+  static constexpr uint32_t MAX_BUCKET_SIZE = 256;
+
+  // Size of the array layers holding a texture
+  uint32_t getArraySize(uint32_t size) const;
+  unsigned int getArray(uint32_t width, uint32_t height);
+  // Unused dedicated array given fresh single layer storage, left bound
+  unsigned int getDedicatedArray(GLenum format, uint32_t width, uint32_t height);
+  void grow(TextureArray &textureArray);
+  void setInstanceOffset(std::size_t first);
+
+  GlState state;
+  Program program;
+  GLint viewportSizeLocation;
+  Program externalProgram;
+  GLint externalViewportSizeLocation;
+  Vao vao;
+  glBuffer instanceBuffer;
+  std::size_t instanceBufferSize;
+  GLint maxLayers;
+  GLint maxTextureSize;
+  Framebuffer copyFramebuffer;
+  TextureUploader uploader;
+  std::vector<TextureArray> arrays;
+  std::vector<Instance> instances;
+  unsigned int drawCallCount;
+};
+
+#endif /* !SURFACERENDERER_HPP_ */
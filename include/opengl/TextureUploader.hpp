@@ -0,0 +1,59 @@
+#ifndef TEXTUREUPLOADER_HPP_
+# define TEXTUREUPLOADER_HPP_
+
+# include <cstddef>
+# include <cstdint>
+# include <deque>
+# include "my_opengl.hpp"
+# include <GLES2/gl2ext.h>
+
+/*
+ * Streams texture uploads through a ring of pixel unpack buffer memory.
+ * Pixels are copied into the ring and the GPU reads them whenever it gets to the upload,
+ * the render thread never waits for a glTexSubImage to complete.
+ * The ring stays mapped for its whole life with GL_EXT_buffer_storage, otherwise each upload maps its range.
+ * Every upload is guarded by a fence, its range is only overwritten once the GPU is done with it.
+ */
+class TextureUploader
+{
+public:
+  static constexpr std::size_t DEFAULT_CAPACITY = 32u << 20u;
+
+  explicit TextureUploader(std::size_t capacity = DEFAULT_CAPACITY);
+  ~TextureUploader();
+  TextureUploader(TextureUploader const &) = delete;
+  TextureUploader &operator=(TextureUploader const &) = delete;
+
+  // Uploads a width x height rectangle of RGBA pixels at (x, y) of the texture bound to target.
+  // layer is the z offset for GL_TEXTURE_2D_ARRAY and ignored for GL_TEXTURE_2D.
+  // stride is the distance in bytes between the rows of pixels, a multiple of 4.
+  void upload(GLenum target, GLint layer, GLint x, GLint y, GLsizei width, GLsizei height,
+	      void const *pixels, std::size_t stride);
+
+  bool isPersistent() const;
+  // Uploads that had to wait for the GPU to free ring space
+  unsigned int getStallCount() const;
+
+private:
+  struct Pending
+  {
+    std::size_t begin;
+    std::size_t end;
+    GLsync fence;
+  };
+
+  // Offset of size bytes of ring space the GPU no longer reads
+  std::size_t allocate(std::size_t size);
+  void retire();
+
+  std::size_t capacity;
+  glBuffer buffer;
+  // whole ring when persistently mapped
+  unsigned char *mapping;
+  std::size_t head;
+  // oldest first, in ring order
+  std::deque<Pending> pending;
+  unsigned int stallCount;
+};
+
+#endif /* !TEXTUREUPLOADER_HPP_ */
@@ -5,17 +5,21 @@
 # include <array>
 # include <GLES3/gl3.h>
 
+/*
+ * Owning handles of GL objects, deleted with the handle.
+ * They are move only, a moved from handle holds 0 which GL ignores on delete.
+ */
 class Shader
 {
 public:
   GLuint shader;
-private:
-  unsigned int *count;
 public:
-  Shader(GLuint);
+  explicit Shader(GLuint);
   ~Shader();
-  Shader(Shader const &);
-  Shader &operator=(Shader);
+  Shader(Shader const &) = delete;
+  Shader(Shader &&) noexcept;
+  Shader &operator=(Shader const &) = delete;
+  Shader &operator=(Shader &&) noexcept;
   operator GLuint() const;
 };
 
@@ -23,13 +27,13 @@ class Program
 {
 public:
   GLuint program;
-private:
-  unsigned int *count;
 public:
   Program();
   ~Program();
-  Program(Program const &);
-  Program &operator=(Program);
+  Program(Program const &) = delete;
+  Program(Program &&) noexcept;
+  Program &operator=(Program const &) = delete;
+  Program &operator=(Program &&) noexcept;
   operator GLuint() const;
 };
 
@@ -37,13 +41,13 @@ class Vao
 {
 public:
   GLuint vao;
-private:
-  unsigned int *count;
 public:
   Vao();
   ~Vao();
-  Vao(Vao const &);
-  Vao &operator=(Vao);
+  Vao(Vao const &) = delete;
+  Vao(Vao &&) noexcept;
+  Vao &operator=(Vao const &) = delete;
+  Vao &operator=(Vao &&) noexcept;
   operator GLuint() const;
 };
 
@@ -51,13 +55,13 @@ class glBuffer
 {
 public:
   GLuint buffer;
-private:
-  unsigned int *count;
 public:
   glBuffer();
   ~glBuffer();
-  glBuffer(glBuffer const &);
-  glBuffer &operator=(glBuffer);
+  glBuffer(glBuffer const &) = delete;
+  glBuffer(glBuffer &&) noexcept;
+  glBuffer &operator=(glBuffer const &) = delete;
+  glBuffer &operator=(glBuffer &&) noexcept;
   operator GLuint() const;
 };
 
@@ -65,13 +69,13 @@ class Framebuffer
 {
 public:
   GLuint framebuffer;
-private:
-  unsigned int *count;
 public:
   Framebuffer();
   ~Framebuffer();
-  Framebuffer(Framebuffer const &);
-  Framebuffer &operator=(Framebuffer);
+  Framebuffer(Framebuffer const &) = delete;
+  Framebuffer(Framebuffer &&) noexcept;
+  Framebuffer &operator=(Framebuffer const &) = delete;
+  Framebuffer &operator=(Framebuffer &&) noexcept;
   operator GLuint() const;
 };
 
@@ -79,13 +83,13 @@ class Texture
 {
 public:
   GLuint texture;
-private:
-  unsigned int *count;
 public:
   Texture();
   ~Texture();
-  Texture(Texture const &);
-  Texture &operator=(Texture);
+  Texture(Texture const &) = delete;
+  Texture(Texture &&) noexcept;
+  Texture &operator=(Texture const &) = delete;
+  Texture &operator=(Texture &&) noexcept;
   operator GLuint() const;
 };
 
@@ -95,9 +99,12 @@ namespace	my_opengl
   Shader	createShader(GLenum const shadertype, GLchar const *src);
   void		programError(GLuint const program);
   Program	createProgram(std::string const& name);
+  // Program made of shaders/vertexName.vert and shaders/fragmentName.frag, built into the binary,
+  // linked once then loaded back from a binary in $XDG_CACHE_HOME/feathers
+  Program	createProgram(std::string const &vertexName, std::string const &fragmentName);
 
   template<unsigned int count>
-  Program createProgram(std::array<Shader const, count> const shaders)
+  Program createProgram(std::array<GLuint, count> const &shaders)
   {
     Program program;
     GLint status;
@@ -113,7 +120,10 @@ namespace	my_opengl
     return (program);
   }
 
-  Texture loadTexture(std::string const &name);
+  // GL internal format of a KTX2 VkFormat, 0 when this GL can't sample it
+  GLenum getKtx2Format(uint32_t vkFormat);
+  // Texture swizzle sampling BMP pixels as RGBA, the file stores each pixel with its bytes reversed
+  constexpr std::array<GLint, 4u> BMP_SWIZZLE{{GL_ALPHA, GL_BLUE, GL_GREEN, GL_RED}};
 };
 
 #endif // MY_OPENGL_HPP_
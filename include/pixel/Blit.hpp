@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * 32 bit per pixel blit and blend kernels used by the software renderer.
+ * Strides are in bytes. The fastest implementation the cpu supports is picked at runtime.
+ */
+namespace pixel
+{
+  void copy(void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, uint32_t width, uint32_t height);
+  void fill(void *dst, std::size_t dstStride, uint32_t color, uint32_t width, uint32_t height);
+  // Premultiplied ARGB8888 source over an XRGB8888/ARGB8888 destination
+  void blend(void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, uint32_t width, uint32_t height);
+}
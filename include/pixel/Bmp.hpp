@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "pixel/MappedFile.hpp"
+
+namespace pixel
+{
+  // 32 bit pixels exactly as stored in the BMP file, bottom row first
+  struct Image
+  {
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint32_t> pixels;
+  };
+
+  // Same pixels read in place from the mapped file, not necessarily 4 bytes aligned
+  struct MappedBmp
+  {
+    MappedFile file;
+    uint32_t width;
+    uint32_t height;
+    uint8_t const *pixels;
+  };
+
+  MappedBmp mapBmp(std::string const &name);
+  Image loadBmp(std::string const &name);
+}
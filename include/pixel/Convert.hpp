@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Pixel format conversion kernels shared by the texture loaders, uploads and the software renderer.
+ * Strides are in bytes. The fastest implementation the cpu supports is picked at runtime,
+ * every one gives exactly the same result as the scalar one.
+ */
+namespace pixel
+{
+  // Source byte of each destination byte of a pixel, OPAQUE writes 0xff
+  using Swizzle = std::array<uint8_t, 4u>;
+
+  constexpr uint8_t OPAQUE = 0xff;
+  // ABGR <-> RGBA, e.g. the reversed pixels of our BMP files
+  constexpr Swizzle REVERSE_BYTES{3, 2, 1, 0};
+  // RGBA <-> BGRA, also RGBA bytes <-> ARGB8888 words
+  constexpr Swizzle SWAP_RED_BLUE{2, 1, 0, 3};
+  // RGB bytes to RGBA bytes, and RGBA to RGBX
+  constexpr Swizzle RGB_TO_RGBX{0, 1, 2, OPAQUE};
+  // RGB bytes to XRGB8888 words (B, G, R, X bytes)
+  constexpr Swizzle RGB_TO_XRGB{2, 1, 0, OPAQUE};
+
+  // 32 bit pixels, dst may be src
+  void swizzle(void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, uint32_t width, uint32_t height,
+	       Swizzle const &order);
+  // 24 bit pixels to 32 bit ones, order only picks among the source bytes 0 to 2
+  void expandRgb888(void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, uint32_t width, uint32_t height,
+		    Swizzle const &order);
+  // RGB565 to XRGB8888, the low bits of each channel replicate its high bits so white stays white
+  void expandRgb565(void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, uint32_t width, uint32_t height);
+  // Multiplies the color bytes of 32 bit pixels by their alpha, byte 3 (ARGB8888 words or RGBA bytes), dst may be src
+  void premultiply(void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, uint32_t width, uint32_t height);
+  // rowSize bytes of each row, in one go when both buffers are packed
+  void copyRows(void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, std::size_t rowSize, uint32_t height);
+}
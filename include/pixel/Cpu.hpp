@@ -0,0 +1,15 @@
+#pragma once
+
+namespace pixel
+{
+  // SIMD extensions the pixel kernels may use, detected once at startup.
+  // FEATHERS_SIMD=scalar|sse2|ssse3|avx2 caps the level, to benchmark or compare kernels.
+  struct CpuFeatures
+  {
+    bool sse2;
+    bool ssse3;
+    bool avx2;
+  };
+
+  CpuFeatures const &getCpuFeatures();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "pixel/MappedFile.hpp"
+
+namespace pixel
+{
+  /*
+   * 2D texture of a KTX2 container, its levels are read in place from the mapped file.
+   * Only plain data is accepted, no supercompression (Basis, zstd), arrays or cube maps.
+   */
+  struct Ktx2
+  {
+    struct Level
+    {
+      uint8_t const *data;
+      std::size_t size;
+    };
+
+    MappedFile file;
+    // VkFormat of the texels, e.g. ETC2 or ASTC blocks
+    uint32_t vkFormat;
+    uint32_t width;
+    uint32_t height;
+    // largest first
+    std::vector<Level> levels;
+    // rows are stored top first unless KTXorientation says otherwise
+    bool topRowFirst;
+  };
+
+  Ktx2 loadKtx2(std::string const &name);
+}
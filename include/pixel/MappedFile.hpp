@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace pixel
+{
+  /*
+   * Read only mapping of a whole file, assets are parsed and uploaded in place
+   * instead of being read into a buffer first.
+   */
+  class MappedFile
+  {
+  public:
+    explicit MappedFile(std::string const &name);
+    MappedFile(MappedFile const &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    ~MappedFile();
+
+    uint8_t const *getData() const;
+    std::size_t getSize() const;
+
+  private:
+    void *data;
+    std::size_t size;
+  };
+}
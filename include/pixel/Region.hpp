@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace pixel
+{
+  // Rectangle in pixels, origin at the top left
+  struct Rect
+  {
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+
+    bool isEmpty() const;
+    bool contains(Rect const &other) const;
+    Rect intersect(Rect const &other) const;
+  };
+
+  /*
+   * Set of pixels as non overlapping rectangles, used to accumulate damage.
+   * Past a few rectangles it degrades to its bounding box, repainting a little more is cheaper
+   * than scissoring or clipping many small rectangles.
+   */
+  class Region
+  {
+  public:
+    Region() = default;
+    explicit Region(Rect const &rect);
+
+    void add(Rect const &rect);
+    void add(Region const &region);
+    // Keeps only the part inside clip
+    void intersect(Rect const &clip);
+    // Removes cut, past the rectangle limit what's left degrades to its bounding box like add
+    void subtract(Rect const &cut);
+    void clear();
+
+    bool isEmpty() const;
+    Rect getExtents() const;
+    std::vector<Rect> const &getRects() const;
+
+  private:
+    static constexpr std::size_t MAX_RECTS = 16;
+
+    std::vector<Rect> rects;
+  };
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "pixel/Region.hpp"
+
+class Output;
+
+/*
+ * Draws the frame of an output with the CPU, into its dumb buffers.
+ * The background is converted to the scanout format once, so a frame is a copy
+ * plus the blend of whatever couldn't go on a plane.
+ */
+class SoftwareCompositor
+{
+public:
+  SoftwareCompositor();
+
+  // Repaints part of the output's back buffer, the output must use the software backend
+  void draw(Output &output, pixel::Region const &repaint);
+
+private:
+  // Background scaled to one output size, in XRGB8888
+  struct Background
+  {
+    int width;
+    int height;
+    std::vector<uint32_t> pixels;
+  };
+
+  Background const &getBackground(int width, int height);
+
+  uint32_t imageWidth;
+  uint32_t imageHeight;
+  // XRGB8888, top row first
+  std::vector<uint32_t> image;
+  std::vector<Background> backgrounds;
+};
@@ -1,10 +1,24 @@
 #version 450
 
+// Built twice: with NON_UNIFORM_INDEXING for devices enabling descriptor indexing, every surface is then in one draw.
+// Without it a draw only has surfaces sharing a texture, the index is dynamically uniform.
+#ifdef NON_UNIFORM_INDEXING
+#extension GL_EXT_nonuniform_qualifier : require
+#define TEXTURE_INDEX(index) nonuniformEXT(index)
+#else
+#define TEXTURE_INDEX(index) (index)
+#endif
+
+// Renderer::MAX_TEXTURES
+#define MAX_TEXTURES 256
+
 layout(location = 0) in vec2 fragTexCoord;
+layout(location = 1) flat in uint fragTexture;
 layout(location = 0) out vec4 outColor;
 
-layout(set = 0, binding = 0) uniform sampler2D image;
+// the textures given to addTexture, the slots not given out yet hold the background
+layout(set = 0, binding = 1) uniform sampler2D textures[MAX_TEXTURES];
 
 void main() {
-  outColor = vec4(texture(image, fragTexCoord).rgb, 1.0f);
-}
\ No newline at end of file
+  outColor = vec4(texture(textures[TEXTURE_INDEX(fragTexture)], fragTexCoord).rgb, 1.0f);
+}
@@ -1,12 +1,23 @@
 #version 450
 
-layout(location = 0) in vec2 pos;
-layout(location = 1) in vec2 texCoord;
+// One instance per surface, the quad corners come from the vertex index (triangle strip of 4 vertices)
+struct SurfaceInstance
+{
+  vec2 position; // top left, in pixels
+  vec2 size; // in pixels
+  uint texture; // index in the textures of basic.frag
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Surfaces
+{
+  SurfaceInstance surfaces[];
+};
 
 layout(constant_id = 0) const float screenXSize = 1.0; // window x scaling
 layout(constant_id = 1) const float screenYSize = 1.0; // window y scaling
 
 layout(location = 0) out vec2 fragTexCoord;
+layout(location = 1) flat out uint fragTexture;
 
 out gl_PerVertex
 {
@@ -16,7 +27,10 @@ out gl_PerVertex
 void main()
 {
   const vec2 screenSize = vec2(screenXSize, screenYSize);
+  vec2 corner = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1);
+  SurfaceInstance surface = surfaces[gl_InstanceIndex];
 
-  fragTexCoord = texCoord / screenSize;
-  gl_Position = vec4(pos / screenSize, 0.0, 1.0);
+  fragTexCoord = corner;
+  fragTexture = surface.texture;
+  gl_Position = vec4((surface.position + corner * surface.size) / screenSize, 0.0, 1.0);
 }
@@ -0,0 +1,18 @@
+#version 300 es
+
+out highp vec4 outColor;
+
+in highp vec3 fragTexCoord;
+flat in highp float fragOpacity;
+flat in highp float fragOpaque;
+
+uniform highp sampler2DArray images;
+
+void main()
+{
+  highp vec4 color = texture(images, fragTexCoord);
+
+  color.a = max(color.a, fragOpaque);
+  // premultiplied alpha, opacity scales every channel
+  outColor = color * fragOpacity;
+}
@@ -0,0 +1,25 @@
+#version 300 es
+
+// x, y, width, height on screen in pixels
+layout (location = 0) in vec4 dst;
+// u, v, width, height in normalized texture coordinates
+layout (location = 1) in vec4 src;
+// layer, opacity, opaque
+layout (location = 2) in vec3 params;
+
+uniform vec2 viewportSize;
+
+out vec3 fragTexCoord;
+flat out float fragOpacity;
+flat out float fragOpaque;
+
+void main()
+{
+  // the quad is a triangle strip generated from the vertex id
+  vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));
+
+  gl_Position = vec4((dst.xy + corner * dst.zw) / viewportSize * vec2(2.0, -2.0) + vec2(-1.0, 1.0), 0.0, 1.0);
+  fragTexCoord = vec3(src.xy + corner * src.zw, params.x);
+  fragOpacity = params.y;
+  fragOpaque = params.z;
+}
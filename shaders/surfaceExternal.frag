@@ -0,0 +1,19 @@
+#version 300 es
+#extension GL_OES_EGL_image_external_essl3 : require
+
+out highp vec4 outColor;
+
+in highp vec3 fragTexCoord;
+flat in highp float fragOpacity;
+flat in highp float fragOpaque;
+
+// imported buffer, sampled in place
+uniform highp samplerExternalOES image;
+
+void main()
+{
+  highp vec4 color = texture(image, fragTexCoord.xy);
+
+  color.a = max(color.a, fragOpaque);
+  outColor = color * fragOpacity;
+}
@@ -0,0 +1,68 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CacheFile.hpp"
+
+std::string cache::getPath(std::string const &name)
+{
+  std::string directory;
+
+  if (char const *cacheHome = getenv("XDG_CACHE_HOME"); cacheHome && *cacheHome)
+    directory = cacheHome;
+  else if (char const *home = getenv("HOME"); home && *home)
+    directory = std::string(home) + "/.cache";
+  else
+    return {};
+  mkdir(directory.c_str(), 0755);
+  directory += "/feathers";
+  if (mkdir(directory.c_str(), 0755) && errno != EEXIST)
+    return {};
+  return directory + "/" + name;
+}
+
+bool cache::read(std::istream &input, uint64_t size, std::vector<char> &data)
+{
+  std::streamoff const position(input.tellg());
+
+  if (position < 0 || !input.seekg(0, std::ios::end))
+    return false;
+
+  std::streamoff const end(input.tellg());
+
+  if (end < position || static_cast<uint64_t>(end - position) < size || !input.seekg(position))
+    return false;
+  data.resize(size);
+  return static_cast<bool>(input.read(data.data(), static_cast<std::streamsize>(size)));
+}
+
+bool cache::write(std::string const &path, std::initializer_list<std::string_view> parts)
+{
+  // a unique name, so that processes writing the same cache at once don't share a file
+  std::string temporaryPath(path + ".XXXXXX");
+  int const fd(mkstemp(temporaryPath.data()));
+  bool written(fd >= 0);
+
+  if (!written)
+    return false;
+  for (std::string_view part : parts)
+    while (written && !part.empty())
+      {
+	ssize_t const count(::write(fd, part.data(), part.size()));
+
+	if (count < 0 && errno == EINTR)
+	  continue;
+	written = count > 0;
+	if (written)
+	  part.remove_prefix(static_cast<std::size_t>(count));
+      }
+  written = !close(fd) && written;
+  if (!written || rename(temporaryPath.c_str(), path.c_str()))
+    {
+      unlink(temporaryPath.c_str());
+      return false;
+    }
+  return true;
+}
@@ -0,0 +1,12 @@
+#include <stdexcept>
+#include <string>
+
+#include "EmbeddedShaders.hpp"
+
+std::string_view shaders::get(std::string_view name)
+{
+  for (std::size_t i = 0; i < embeddedFileCount; ++i)
+    if (name == embeddedFiles[i].name)
+      return {reinterpret_cast<char const *>(embeddedFiles[i].data), embeddedFiles[i].size};
+  throw std::runtime_error("No shader " + std::string(name) + " in the binary");
+}
@@ -0,0 +1,150 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "CacheFile.hpp"
+#include "display/PipelineCache.hpp"
+
+namespace display
+{
+  namespace
+  {
+    // Written before the cache data, with what the driver's own header lacks
+    struct PipelineCacheHeader
+    {
+      char magic[4];
+      uint32_t vendorID;
+      uint32_t deviceID;
+      uint32_t driverVersion;
+      uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+      uint64_t size;
+    };
+
+    // Layout of VkPipelineCacheHeaderVersionOne, at the start of the cache data
+    struct DriverHeader
+    {
+      uint32_t headerSize;
+      uint32_t headerVersion;
+      uint32_t vendorID;
+      uint32_t deviceID;
+      uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    };
+
+    constexpr char PIPELINE_CACHE_MAGIC[4] = {'F', 'P', 'C', '1'};
+
+    bool isSameDevice(uint32_t vendorID, uint32_t deviceID, uint8_t const *pipelineCacheUUID, vk::PhysicalDeviceProperties const &properties)
+    {
+      return vendorID == properties.vendorID && deviceID == properties.deviceID &&
+	!memcmp(pipelineCacheUUID, &properties.pipelineCacheUUID[0], VK_UUID_SIZE);
+    }
+
+    // Empty when there's nowhere to cache
+    std::string getCachePath(vk::PhysicalDeviceProperties const &properties)
+    {
+      char name[32];
+
+      snprintf(name, sizeof(name), "%04x-%04x.pipelines", properties.vendorID, properties.deviceID);
+      return cache::getPath(name);
+    }
+
+    // Empty when the file is missing, truncated, corrupt or was written for another device or driver
+    std::vector<char> loadCacheData(std::string const &path, vk::PhysicalDeviceProperties const &properties)
+    {
+      std::ifstream input(path, std::ios::binary);
+      PipelineCacheHeader header;
+
+      if (!input.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+	  memcmp(header.magic, PIPELINE_CACHE_MAGIC, sizeof(header.magic)) ||
+	  header.driverVersion != properties.driverVersion ||
+	  !isSameDevice(header.vendorID, header.deviceID, header.pipelineCacheUUID, properties))
+	return {};
+
+      std::vector<char> data;
+      if (!cache::read(input, header.size, data))
+	return {};
+
+      // drivers should ignore foreign data, some crash on it instead
+      DriverHeader driverHeader;
+      if (data.size() < sizeof(driverHeader))
+	return {};
+      memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+      if (driverHeader.headerSize < sizeof(driverHeader) || driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+	  !isSameDevice(driverHeader.vendorID, driverHeader.deviceID, driverHeader.pipelineCacheUUID, properties))
+	return {};
+      return data;
+    }
+  }
+
+  GraphicsPipeline::GraphicsPipeline(vk::Device device, vk::Pipeline pipeline) noexcept
+    : device(device)
+    , pipeline(pipeline)
+  {
+  }
+
+  GraphicsPipeline::GraphicsPipeline(GraphicsPipeline &&other) noexcept
+    : device(other.device)
+    , pipeline(other.pipeline)
+  {
+    other.pipeline = nullptr;
+  }
+
+  GraphicsPipeline &GraphicsPipeline::operator=(GraphicsPipeline &&other) noexcept
+  {
+    std::swap(device, other.device);
+    std::swap(pipeline, other.pipeline);
+    return *this;
+  }
+
+  GraphicsPipeline::~GraphicsPipeline()
+  {
+    if (pipeline)
+      device.destroyPipeline(pipeline);
+  }
+
+  PipelineCache::PipelineCache(vk::Device device, vk::PhysicalDevice physicalDevice)
+    : device(device)
+    , properties(physicalDevice.getProperties())
+    , path(getCachePath(properties))
+  {
+    std::vector<char> data;
+
+    if (!path.empty())
+      data = loadCacheData(path, properties);
+    cache = device.createPipelineCache(vk::PipelineCacheCreateInfo{{}, data.size(), data.data()});
+  }
+
+  PipelineCache::~PipelineCache()
+  {
+    device.destroyPipelineCache(cache);
+  }
+
+  GraphicsPipeline PipelineCache::createGraphicsPipeline(vk::GraphicsPipelineCreateInfo const &createInfo) const
+  {
+    vk::Pipeline pipeline;
+    vk::Result result(device.createGraphicsPipelines(cache, 1, &createInfo, nullptr, &pipeline));
+
+    if (result != vk::Result::eSuccess)
+      throw std::runtime_error("Cannot create a graphics pipeline: " + vk::to_string(result));
+    return {device, pipeline};
+  }
+
+  void PipelineCache::save() const
+  {
+    if (path.empty())
+      return;
+
+    auto data(device.getPipelineCacheData(cache));
+    PipelineCacheHeader header{{}, properties.vendorID, properties.deviceID, properties.driverVersion, {}, data.size()};
+
+    memcpy(header.magic, PIPELINE_CACHE_MAGIC, sizeof(header.magic));
+    memcpy(header.pipelineCacheUUID, &properties.pipelineCacheUUID[0], VK_UUID_SIZE);
+
+    if (!cache::write(path, {{reinterpret_cast<char const *>(&header), sizeof(header)},
+			     {reinterpret_cast<char const *>(data.data()), data.size()}}))
+      std::cerr << "Cannot write the pipeline cache to " << path << std::endl;
+  }
+}
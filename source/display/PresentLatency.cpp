@@ -0,0 +1,66 @@
+#include <algorithm>
+#include <vector>
+
+#include "display/PresentLatency.hpp"
+
+namespace display
+{
+  namespace
+  {
+    double toMilliseconds(std::chrono::nanoseconds time)
+    {
+      return std::chrono::duration<double, std::milli>(time).count();
+    }
+  }
+
+  void PresentLatency::acquired(uint64_t presentId)
+  {
+    if (pending.size() == MAX_PENDING)
+      pending.pop_front();
+    pending.push_back({presentId, std::chrono::steady_clock::now()});
+  }
+
+  void PresentLatency::presented(uint64_t presentId, std::chrono::steady_clock::time_point presentTime)
+  {
+    while (!pending.empty() && pending.front().presentId < presentId)
+      pending.pop_front();
+    if (pending.empty() || pending.front().presentId != presentId)
+      return;
+    if (samples.size() == WINDOW)
+      samples.pop_front();
+    samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(presentTime - pending.front().acquireTime));
+    pending.pop_front();
+  }
+
+  PresentLatency::Stats PresentLatency::getStats() const
+  {
+    if (samples.empty())
+      return {0, {}, {}, {}, {}, {}};
+
+    std::vector<std::chrono::nanoseconds> sorted(samples.begin(), samples.end());
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile([&](std::size_t percent)
+		    {
+		      return sorted[(sorted.size() - 1) * percent / 100];
+		    });
+
+    return {sorted.size(), sorted.front(), percentile(50), percentile(90), percentile(99), sorted.back()};
+  }
+
+  void PresentLatency::print(std::ostream &output, vk::PresentModeKHR presentMode) const
+  {
+    Stats stats(getStats());
+
+    if (!stats.count)
+      {
+	output << "acquire to present " << vk::to_string(presentMode)
+	       << ": no samples, VK_KHR_present_wait and VK_GOOGLE_display_timing are missing or no present was reported" << std::endl;
+	return;
+      }
+    output << "acquire to present " << vk::to_string(presentMode) << " (ms, last " << stats.count << "): min " << toMilliseconds(stats.min)
+	   << ", p50 " << toMilliseconds(stats.p50)
+	   << ", p90 " << toMilliseconds(stats.p90)
+	   << ", p99 " << toMilliseconds(stats.p99)
+	   << ", max " << toMilliseconds(stats.max) << std::endl;
+  }
+}
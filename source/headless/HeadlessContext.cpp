@@ -0,0 +1,184 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <string>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "headless/HeadlessContext.hpp"
+#include "Exception.hpp"
+
+namespace
+{
+  EGLDisplay getPlatformDisplay(EGLenum platform, void *nativeDisplay)
+  {
+    char const *extensions(eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS));
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplayExt(nullptr);
+
+    if (extensions && strstr(extensions, "EGL_EXT_platform_base"))
+      getPlatformDisplayExt = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (!getPlatformDisplayExt)
+      return EGL_NO_DISPLAY;
+    return getPlatformDisplayExt(platform, nativeDisplay, nullptr);
+  }
+}
+
+HeadlessContext::HeadlessContext(uint32_t width, uint32_t height)
+  : fd(-1),
+    gbmDevice(nullptr),
+    eglDisplay(EGL_NO_DISPLAY),
+    eglContext(EGL_NO_CONTEXT),
+    width(width),
+    height(height)
+{
+  if (!initRenderNode() && !initSurfaceless())
+    {
+      throw HeadlessError("No render node nor surfaceless EGL platform");
+    }
+
+  try
+    {
+      createContext();
+
+      colorBuffer = std::make_unique<Texture>();
+      framebuffer = std::make_unique<Framebuffer>();
+      glBindTexture(GL_TEXTURE_2D, *colorBuffer);
+      glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, static_cast<GLsizei>(width), static_cast<GLsizei>(height));
+      glBindFramebuffer(GL_FRAMEBUFFER, *framebuffer);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, *colorBuffer, 0);
+      if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+	  throw HeadlessError("Offscreen framebuffer is incomplete");
+	}
+      makeCurrent();
+    }
+  catch (...)
+    {
+      framebuffer.reset();
+      colorBuffer.reset();
+      if (eglContext != EGL_NO_CONTEXT)
+	{
+	  eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	  eglDestroyContext(eglDisplay, eglContext);
+	}
+      eglTerminate(eglDisplay);
+      if (gbmDevice)
+	gbm_device_destroy(gbmDevice);
+      if (fd >= 0)
+	close(fd);
+      throw;
+    }
+}
+
+HeadlessContext::~HeadlessContext()
+{
+  framebuffer.reset();
+  colorBuffer.reset();
+  eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(eglDisplay, eglContext);
+  eglTerminate(eglDisplay);
+  if (gbmDevice)
+    gbm_device_destroy(gbmDevice);
+  if (fd >= 0)
+    close(fd);
+}
+
+bool HeadlessContext::initRenderNode()
+{
+  // render nodes need no master and no connector, any GPU will do
+  for (int node = 128; node < 192; ++node)
+    {
+      std::string path("/dev/dri/renderD" + std::to_string(node));
+
+      fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+      if (fd < 0)
+	continue;
+      gbmDevice = gbm_create_device(fd);
+      if (gbmDevice)
+	{
+	  eglDisplay = getPlatformDisplay(EGL_PLATFORM_GBM_KHR, gbmDevice);
+	  if (eglDisplay != EGL_NO_DISPLAY && eglInitialize(eglDisplay, nullptr, nullptr))
+	    {
+	      device = path;
+	      return true;
+	    }
+	  gbm_device_destroy(gbmDevice);
+	  gbmDevice = nullptr;
+	}
+      close(fd);
+      fd = -1;
+    }
+  return false;
+}
+
+bool HeadlessContext::initSurfaceless()
+{
+  eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY);
+  if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, nullptr, nullptr))
+    return false;
+  device = "surfaceless";
+  return true;
+}
+
+void HeadlessContext::createContext()
+{
+  char const *extensions(eglQueryString(eglDisplay, EGL_EXTENSIONS));
+
+  if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context"))
+    {
+      throw HeadlessError("EGL_KHR_surfaceless_context not supported");
+    }
+
+  // the renderer shaders are GLSL ES 3.0
+  eglBindAPI(EGL_OPENGL_ES_API);
+  EGLint attributes[] = {
+    EGL_SURFACE_TYPE, EGL_DONT_CARE,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
+    EGL_RED_SIZE, 8,
+    EGL_GREEN_SIZE, 8,
+    EGL_BLUE_SIZE, 8,
+    EGL_NONE};
+  EGLint contextAttributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_NONE};
+  EGLConfig eglConfig;
+  EGLint numConfig(0);
+
+  if (!eglChooseConfig(eglDisplay, attributes, &eglConfig, 1, &numConfig) || !numConfig)
+    {
+      throw HeadlessError("No GLES 3 EGL config");
+    }
+  eglContext = eglCreateContext(eglDisplay, eglConfig, EGL_NO_CONTEXT, contextAttributes);
+  if (eglContext == EGL_NO_CONTEXT)
+    {
+      throw HeadlessError("Cannot create GLES 3 context");
+    }
+  eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext);
+}
+
+void HeadlessContext::makeCurrent()
+{
+  eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext);
+  glBindFramebuffer(GL_FRAMEBUFFER, *framebuffer);
+  glViewport(0, 0, static_cast<GLsizei>(width), static_cast<GLsizei>(height));
+}
+
+std::string const &HeadlessContext::getDevice() const
+{
+  return device;
+}
+
+std::string HeadlessContext::getRenderer() const
+{
+  return reinterpret_cast<char const *>(glGetString(GL_RENDERER));
+}
+
+uint32_t HeadlessContext::getWidth() const
+{
+  return width;
+}
+
+uint32_t HeadlessContext::getHeight() const
+{
+  return height;
+}
@@ -1,25 +1,349 @@
-#include "display/WaylandSurface.hpp"
-#include "display/Display.ipp"
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#ifdef FEATHERS_VULKAN
+# include "display/WaylandSurface.hpp"
+# include "display/Display.ipp"
+#endif
+#include "display/SuperCorbeau.hpp"
 #include "modeset/ModeSetter.hpp"
-#include "opengl/QuadFullscreen.hpp"
+#include "headless/HeadlessContext.hpp"
+#include "opengl/GlCompositor.hpp"
+#include "software/SoftwareCompositor.hpp"
+#include "pixel/Convert.hpp"
 #include "Exception.hpp"
 
+namespace
+{
+  volatile sig_atomic_t stopRequested(0);
+
+  void onStopSignal(int)
+  {
+    stopRequested = 1;
+  }
+
+  // Catches SIGINT and SIGTERM while alive. They stay blocked outside of wait, so one arriving
+  // between the stopRequested check and the sleep is delivered when the sleep starts instead of being lost.
+  class StopSignals
+  {
+  public:
+    StopSignals()
+    {
+      struct sigaction action{};
+      sigset_t stopSignals;
+
+      stopRequested = 0;
+      action.sa_handler = &onStopSignal;
+      sigemptyset(&action.sa_mask);
+      sigaction(SIGINT, &action, &previousInt);
+      sigaction(SIGTERM, &action, &previousTerm);
+      sigemptyset(&stopSignals);
+      sigaddset(&stopSignals, SIGINT);
+      sigaddset(&stopSignals, SIGTERM);
+      sigprocmask(SIG_BLOCK, &stopSignals, &waitMask);
+    }
+
+    StopSignals(StopSignals const &) = delete;
+    StopSignals &operator=(StopSignals const &) = delete;
+
+    ~StopSignals()
+    {
+      // a signal still pending is handled by onStopSignal before the previous handlers come back
+      sigprocmask(SIG_SETMASK, &waitMask, nullptr);
+      sigaction(SIGINT, &previousInt, nullptr);
+      sigaction(SIGTERM, &previousTerm, nullptr);
+    }
+
+    // ppoll with the stop signals unblocked, nullptr timeout waits forever
+    int wait(pollfd *fds, nfds_t count, timespec const *timeout) const
+    {
+      return ppoll(fds, count, timeout, &waitMask);
+    }
+
+  private:
+    sigset_t waitMask;
+    struct sigaction previousInt;
+    struct sigaction previousTerm;
+  };
+
+  // Drives every output until SIGINT or SIGTERM, or something is typed when stdin is a terminal.
+  // render draws one frame of an output.
+  template<class Render>
+  void runOnTty(ModeSetter &modeSetter, Render render)
+  {
+    auto const &outputs(modeSetter.getOutputs());
+
+    // the logo doubles as cursor image, moving it only costs a plane update when it sits on a cursor plane
+    std::vector<uint32_t> cursorImage(display::superCorbeau::width * display::superCorbeau::height);
+    {
+      std::vector<unsigned char> rgb(cursorImage.size() * 3);
+
+      display::superCorbeau::decode(rgb.data());
+      pixel::expandRgb888(cursorImage.data(), 0, rgb.data(), 0, static_cast<uint32_t>(cursorImage.size()), 1, pixel::RGB_TO_XRGB);
+    }
+    for (auto const &output : outputs)
+      {
+	output->setCursorImage(cursorImage.data(), display::superCorbeau::width, display::superCorbeau::height);
+	output->moveCursor(output->getWidth() / 2, output->getHeight() / 2);
+      }
+
+    // everything has to be drawn once
+    for (auto const &output : outputs)
+      output->getFrameScheduler().scheduleRepaint();
+
+    // stdin only stops us when it's a terminal, under a pipe, /dev/null or a service manager it's readable right away
+    std::array<pollfd, 2u> pollFds{pollfd{modeSetter.getFd(), POLLIN, 0}, pollfd{STDIN_FILENO, POLLIN, 0}};
+    nfds_t const pollFdCount(isatty(STDIN_FILENO) ? 2 : 1);
+
+    // the stop signals get their previous handling back before waiting for the last flips
+    {
+      StopSignals stopSignals;
+
+      while (!stopRequested && !(pollFds[1].revents & (POLLIN | POLLHUP)))
+	{
+	  using Clock = FrameScheduler::Clock;
+	  Clock::time_point now(Clock::now());
+	  Clock::time_point wakeUp(Clock::time_point::max());
+
+	  // each output renders on its own vblank, as late as its render time allows
+	  for (auto const &output : outputs)
+	    {
+	      FrameScheduler &frameScheduler(output->getFrameScheduler());
+
+	      if (output->isPageFlipPending())
+		continue;
+	      Clock::time_point renderStart(frameScheduler.getRenderStart(now));
+	      if (renderStart <= now)
+		{
+		  frameScheduler.onRenderStart(now);
+		  render(*output);
+		  output->swapBuffers();
+		  now = Clock::now();
+		  frameScheduler.onRenderEnd(now);
+		}
+	      else
+		{
+		  wakeUp = std::min(wakeUp, renderStart);
+		}
+	    }
+
+	  // sleep until a flip completes or an output has to start rendering, forever when idle
+	  timespec timeout{0, 0};
+	  timespec *timeoutPtr(nullptr);
+	  if (wakeUp != Clock::time_point::max())
+	    {
+	      std::chrono::nanoseconds delay(std::max(std::chrono::nanoseconds(wakeUp - Clock::now()), std::chrono::nanoseconds(0)));
+
+	      timeout.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(delay).count();
+	      timeout.tv_nsec = (delay % std::chrono::seconds(1)).count();
+	      timeoutPtr = &timeout;
+	    }
+	  // a stop signal interrupts the wait
+	  if (stopSignals.wait(pollFds.data(), pollFdCount, timeoutPtr) > 0 && (pollFds[0].revents & POLLIN))
+	    modeSetter.handleEvents();
+	}
+    }
+    modeSetter.waitPageFlips();
+
+    for (auto const &output : outputs)
+      {
+	Output::PageFlip const &lastPageFlip(output->getLastPageFlip());
+
+	std::cout << "output " << output->getConnectorId() << " (" << output->getWidth() << "x" << output->getHeight() << "): "
+		  << output->getPageFlipCount() << " page flips ("
+		  << output->getFrameScheduler().getMissedFrameCount() << " missed vblanks), last at "
+		  << lastPageFlip.sec << "s " << lastPageFlip.usec << "us (vblank "
+		  << lastPageFlip.sequence << "), "
+		  << output->getAddFbCount() << " framebuffers created, cursor "
+		  << (output->isCursorOnPlane() ? "on a plane" : "needs composition") << std::endl;
+      }
+  }
+
+  // Prints min, median, 90th, 99th percentile and max of a series of frame times
+  void printTimes(char const *name, std::vector<std::chrono::nanoseconds> times)
+  {
+    if (times.empty())
+      {
+	std::cout << name << ": no samples" << std::endl;
+	return;
+      }
+    std::sort(times.begin(), times.end());
+
+    auto ms([](std::chrono::nanoseconds time)
+	    {
+	      return std::chrono::duration<double, std::milli>(time).count();
+	    });
+    auto percentile([&](std::size_t percent)
+		    {
+		      return ms(times[(times.size() - 1) * percent / 100]);
+		    });
+
+    std::cout << name << " (ms): min " << ms(times.front())
+	      << ", p50 " << percentile(50)
+	      << ", p90 " << percentile(90)
+	      << ", p99 " << percentile(99)
+	      << ", max " << ms(times.back()) << std::endl;
+  }
+
+  struct HeadlessOptions
+  {
+    uint32_t width;
+    uint32_t height;
+    unsigned int refreshRate;
+    unsigned int frameCount;
+    GlCompositor::Scene scene;
+    // repainted every frame, the whole screen by default
+    pixel::Rect damage;
+    // Chrome trace of the GPU spans written there at the end, if not null
+    char const *traceFile;
+  };
+
+  // Renders frames offscreen on a virtual vblank and reports what each one cost
+  void runHeadless(HeadlessOptions const &options)
+  {
+    using Clock = std::chrono::steady_clock;
+    uint32_t const width(options.width);
+    uint32_t const height(options.height);
+    HeadlessContext context(width, height);
+    GlCompositor glCompositor(options.scene);
+    pixel::Region const fullScreen(pixel::Rect{0, 0, static_cast<int32_t>(width), static_cast<int32_t>(height)});
+    pixel::Region repaint(options.damage.isEmpty() ? fullScreen : pixel::Region(options.damage));
+    GpuProfiler &profiler(glCompositor.getProfiler());
+    std::chrono::nanoseconds const refreshPeriod(std::chrono::nanoseconds(std::chrono::seconds(1)) / options.refreshRate);
+    std::vector<std::chrono::nanoseconds> cpuTimes;
+    std::vector<std::chrono::nanoseconds> gpuTimes;
+    unsigned int missedFrames(0);
+
+    std::cout << "headless " << width << "x" << height << " at " << options.refreshRate << "Hz on "
+	      << context.getDevice() << " (" << context.getRenderer() << "), GPU time from "
+	      << (profiler.isSupported() ? "timer queries" : "glFinish") << std::endl;
+
+    // the first frame pays for shader compilation and uploads, keep it out of the numbers
+    context.makeCurrent();
+    glCompositor.draw(width, height, fullScreen);
+    glFinish();
+    profiler.collect(true);
+    profiler.clear();
+
+    Clock::time_point vblank(Clock::now());
+    for (unsigned int frame = 0; frame < options.frameCount; ++frame)
+      {
+	std::this_thread::sleep_until(vblank);
+
+	Clock::time_point renderStart(Clock::now());
+	context.makeCurrent();
+	// the offscreen framebuffer keeps its content, only the damage has to be repainted
+	glCompositor.draw(width, height, repaint);
+	glFlush();
+	Clock::time_point renderEnd(Clock::now());
+
+	cpuTimes.push_back(renderEnd - renderStart);
+	profiler.collect();
+	// without timer queries the GPU time is taken on the CPU, waiting for the GPU to be done
+	if (!profiler.isSupported())
+	  {
+	    glFinish();
+	    gpuTimes.push_back(Clock::now() - renderStart);
+	  }
+
+	// a frame that ran past the next vblank would have been shown one refresh late
+	vblank += refreshPeriod;
+	if (renderEnd > vblank)
+	  {
+	    auto late((renderEnd - vblank) / refreshPeriod + 1);
+
+	    missedFrames += static_cast<unsigned int>(late);
+	    vblank += late * refreshPeriod;
+	  }
+      }
+    glFinish();
+    profiler.collect(true);
+
+    repaint.intersect(fullScreen.getExtents());
+    std::cout << options.frameCount << " frames of " << options.scene.windowCount << " windows in "
+	      << glCompositor.getDrawCallCount() << " draw calls (" << glCompositor.getCulledCount() << " hidden surfaces skipped) repainting " << repaint.getExtents().width << "x"
+	      << repaint.getExtents().height << ", " << missedFrames << " missed vblanks" << std::endl;
+    std::cout << glCompositor.getState().getCallCount() << " GL state changes issued, "
+	      << glCompositor.getState().getElidedCallCount() << " redundant ones skipped" << std::endl;
+    printTimes("cpu", cpuTimes);
+    if (!profiler.isSupported())
+      printTimes("gpu", gpuTimes);
+    profiler.print(std::cout);
+    if (profiler.getStallCount())
+      std::cout << profiler.getStallCount() << " GPU timestamps waited for, the query ring is too small" << std::endl;
+    if (options.traceFile && !profiler.writeTrace(options.traceFile))
+      std::cerr << "Cannot write GPU trace to " << options.traceFile << std::endl;
+  }
+
+  void onTraceSignal(int)
+  {
+    GpuProfiler::requestTrace();
+  }
+}
+
 int main(int argc, char **argv)
 {
-  if (argc == 1)
+  if (argc == 1 || !strcmp(argv[1], "-sw") || !strcmp(argv[1], "--software"))
     {
       // RUN ON TTY
       try
 	{
-	  ModeSetter modeSetter;
+	  std::unique_ptr<ModeSetter> modeSetter;
+
+	  if (argc == 1)
+	    {
+	      try
+		{
+		  modeSetter = std::make_unique<ModeSetter>(ModeSetter::Backend::Gl);
+		}
+	      catch (ModeSettingError const &e)
+		{
+		  // no usable GPU, e.g. vkms or a simple framebuffer driver
+		  std::cerr << e.what() << ", falling back to software rendering" << std::endl;
+		}
+	    }
+	  if (!modeSetter)
+	    modeSetter = std::make_unique<ModeSetter>(ModeSetter::Backend::Software);
 
-	  QuadFullscreen quadFullscreen;
+	  if (modeSetter->getBackend() == ModeSetter::Backend::Gl)
+	    {
+	      GlCompositor glCompositor;
+
+	      // kill -USR1 dumps the last GPU spans as a Chrome trace
+	      signal(SIGUSR1, onTraceSignal);
+	      runOnTty(*modeSetter, [&](Output &output)
+				    {
+				      PlaneAllocator::Rect const cursorRect(output.getCursorRect());
 
-	  for (int i = 0; i < 100; ++i)
+				      modeSetter->makeCurrent(output);
+				      // the cursor is only drawn here when no plane could take it
+				      glCompositor.setCursor(output.isCursorVisible() && !output.isCursorOnPlane() ? output.getCursorImage().data() : nullptr,
+							     {cursorRect.x, cursorRect.y, static_cast<int32_t>(cursorRect.width), static_cast<int32_t>(cursorRect.height)});
+				      glCompositor.draw(static_cast<uint32_t>(output.getWidth()), static_cast<uint32_t>(output.getHeight()),
+							output.beginFrame());
+				      glCompositor.getProfiler().collect();
+				    });
+	      signal(SIGUSR1, SIG_DFL);
+	      glCompositor.getProfiler().print(std::cout);
+	    }
+	  else
 	    {
-	      quadFullscreen.draw();
-	      modeSetter.swapBuffers();
-	      usleep(100);
+	      SoftwareCompositor softwareCompositor;
+
+	      runOnTty(*modeSetter, [&](Output &output)
+				    {
+				      softwareCompositor.draw(output, output.beginFrame());
+				    });
 	    }
 	}
       catch (ModeSettingError const& e)
@@ -27,17 +351,97 @@ int main(int argc, char **argv)
 	  std::cerr << e.what() << std::endl;
 	}
     }
+  else if (!strcmp(argv[1], "-hl") || !strcmp(argv[1], "--headless"))
+    {
+      // --headless [WIDTHxHEIGHT] [--refresh HZ] [--frames COUNT] [--windows COUNT] [--opaque] [--maximized] [--damage WIDTHxHEIGHT] [--trace FILE]
+      HeadlessOptions options{1920, 1080, 60, 600, {0, false, false}, {0, 0, 0, 0}, nullptr};
+
+      for (int i = 2; i < argc; ++i)
+	{
+	  if (!strcmp(argv[i], "--refresh") && i + 1 < argc)
+	    options.refreshRate = static_cast<unsigned int>(std::max(1l, strtol(argv[++i], nullptr, 10)));
+	  else if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+	    options.frameCount = static_cast<unsigned int>(std::max(1l, strtol(argv[++i], nullptr, 10)));
+	  else if (!strcmp(argv[i], "--windows") && i + 1 < argc)
+	    options.scene.windowCount = static_cast<unsigned int>(std::max(0l, strtol(argv[++i], nullptr, 10)));
+	  else if (!strcmp(argv[i], "--opaque"))
+	    options.scene.opaqueWindows = true;
+	  else if (!strcmp(argv[i], "--maximized"))
+	    options.scene.maximizedWindow = true;
+	  else if (!strcmp(argv[i], "--trace") && i + 1 < argc)
+	    options.traceFile = argv[++i];
+	  else if (!strcmp(argv[i], "--damage") && i + 1 < argc &&
+		   sscanf(argv[++i], "%dx%d", &options.damage.width, &options.damage.height) == 2)
+	    continue;
+	  else if (sscanf(argv[i], "%ux%u", &options.width, &options.height) != 2 || !options.width || !options.height)
+	    {
+	      std::cerr << "usage: " << argv[0]
+			<< " --headless [WIDTHxHEIGHT] [--refresh HZ] [--frames COUNT] [--windows COUNT] [--opaque] [--maximized] [--damage WIDTHxHEIGHT] [--trace FILE]" << std::endl;
+	      return 1;
+	    }
+	}
+      try
+	{
+	  runHeadless(options);
+	}
+      catch (std::runtime_error const &e)
+	{
+	  std::cerr << e.what() << std::endl;
+	  return 1;
+	}
+    }
   else if (!strcmp(argv[1], "-sc") || !strcmp(argv[1], "--sub-compositor"))
     {
+#ifndef FEATHERS_VULKAN
+      std::cerr << "Built without the sub-compositor, glslangValidator was missing to compile its shaders" << std::endl;
+      return 1;
+#else
+      // --sub-compositor [--frames-in-flight COUNT] [--present-mode fifo|fifo-relaxed|mailbox|immediate]
+      static std::array<std::pair<char const *, vk::PresentModeKHR>, 4u> const presentModes{{
+	  {"fifo", vk::PresentModeKHR::eFifo},
+	  {"fifo-relaxed", vk::PresentModeKHR::eFifoRelaxed},
+	  {"mailbox", vk::PresentModeKHR::eMailbox},
+	  {"immediate", vk::PresentModeKHR::eImmediate}
+	}};
+      unsigned int frameInFlightCount(display::Display::DEFAULT_FRAMES_IN_FLIGHT);
+      vk::PresentModeKHR presentMode(vk::PresentModeKHR::eFifo);
+
+      for (int i = 2; i < argc; ++i)
+	{
+	  auto presentModeIt(presentModes.end());
+
+	  if (!strcmp(argv[i], "--frames-in-flight") && i + 1 < argc)
+	    frameInFlightCount = static_cast<unsigned int>(std::max(1l, strtol(argv[++i], nullptr, 10)));
+	  else if (!strcmp(argv[i], "--present-mode") && i + 1 < argc &&
+		   (presentModeIt = std::find_if(presentModes.begin(), presentModes.end(), [name = argv[i + 1]](auto const &presentMode)
+						 {
+						   return !strcmp(presentMode.first, name);
+						 })) != presentModes.end())
+	    {
+	      presentMode = presentModeIt->second;
+	      ++i;
+	    }
+	  else
+	    {
+	      std::cerr << "usage: " << argv[0] << " --sub-compositor [--frames-in-flight COUNT] [--present-mode fifo|fifo-relaxed|mailbox|immediate]" << std::endl;
+	      return 1;
+	    }
+	}
+
       display::WaylandSurface waylandSurface;
-      display::Display display(waylandSurface);
+      display::Display display(waylandSurface, frameInFlightCount, presentMode);
 
       while (waylandSurface.isRunning())
 	{
+	  // with present wait, blocks until the present frames-in-flight frames ago is shown, the loop runs at the display's pace
+	  display.pace();
 	  display.render();
 	  waylandSurface.dispatch();
 	  //  std::cout << "presenting image" << std::endl;
 	}
+      // compare runs with each --present-mode to pick the lowest latency one for the machine
+      display.getPresentLatency().print(std::cout, display.getPresentMode());
+#endif
     }
 
   std::cout << "Exit" << std::endl;
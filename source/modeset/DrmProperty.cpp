@@ -0,0 +1,63 @@
+#include <string.h>
+#include <string>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "modeset/DrmProperty.hpp"
+#include "Exception.hpp"
+
+namespace drmProperty
+{
+  uint32_t getId(int fd, uint32_t objectId, uint32_t objectType, char const *name)
+  {
+    uint32_t id = findId(fd, objectId, objectType, name);
+
+    if (!id)
+      {
+	throw ModeSettingError(std::string("Property not found: ") + name);
+      }
+    return id;
+  }
+
+  uint32_t findId(int fd, uint32_t objectId, uint32_t objectType, char const *name)
+  {
+    drmModeObjectProperties *properties = drmModeObjectGetProperties(fd, objectId, objectType);
+    uint32_t id = 0;
+
+    if (!properties)
+      {
+	throw ModeSettingError("Cannot get drm object properties");
+      }
+    for (uint32_t i = 0; i < properties->count_props && !id; ++i)
+      {
+	drmModePropertyRes *property = drmModeGetProperty(fd, properties->props[i]);
+
+	if (property && !strcmp(property->name, name))
+	  id = property->prop_id;
+	drmModeFreeProperty(property);
+      }
+    drmModeFreeObjectProperties(properties);
+    return id;
+  }
+
+  uint64_t getValue(int fd, uint32_t objectId, uint32_t objectType, char const *name)
+  {
+    drmModeObjectProperties *properties = drmModeObjectGetProperties(fd, objectId, objectType);
+    uint64_t value = 0;
+
+    if (!properties)
+      {
+	throw ModeSettingError("Cannot get drm object properties");
+      }
+    for (uint32_t i = 0; i < properties->count_props; ++i)
+      {
+	drmModePropertyRes *property = drmModeGetProperty(fd, properties->props[i]);
+
+	if (property && !strcmp(property->name, name))
+	  value = properties->prop_values[i];
+	drmModeFreeProperty(property);
+      }
+    drmModeFreeObjectProperties(properties);
+    return value;
+  }
+}
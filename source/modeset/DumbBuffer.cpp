@@ -0,0 +1,98 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <string>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "modeset/DumbBuffer.hpp"
+#include "Exception.hpp"
+
+DumbBuffer::DumbBuffer(int fd, uint32_t width, uint32_t height, uint32_t format)
+  : fd(fd),
+    width(width),
+    height(height),
+    stride(0),
+    handle(0),
+    size(0),
+    fb(0),
+    pixels(nullptr)
+{
+  drm_mode_create_dumb create{};
+
+  create.width = width;
+  create.height = height;
+  create.bpp = 32;
+  if (drmIoctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &create))
+    {
+      throw ModeSettingError(std::string("Cannot create dumb buffer: ") + strerror(errno));
+    }
+  handle = create.handle;
+  stride = create.pitch;
+  size = create.size;
+
+  try
+    {
+      uint32_t handles[4] = {handle};
+      uint32_t pitches[4] = {stride};
+      uint32_t offsets[4] = {0};
+      if (drmModeAddFB2(fd, width, height, format, handles, pitches, offsets, &fb, 0))
+	{
+	  throw ModeSettingError(std::string("Cannot add dumb framebuffer: ") + strerror(errno));
+	}
+
+      drm_mode_map_dumb map{};
+      map.handle = handle;
+      if (drmIoctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &map))
+	{
+	  throw ModeSettingError(std::string("Cannot map dumb buffer: ") + strerror(errno));
+	}
+      pixels = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, static_cast<off_t>(map.offset));
+      if (pixels == MAP_FAILED)
+	{
+	  pixels = nullptr;
+	  throw ModeSettingError(std::string("Cannot mmap dumb buffer: ") + strerror(errno));
+	}
+    }
+  catch (ModeSettingError const &)
+    {
+      if (fb)
+	drmModeRmFB(fd, fb);
+      drm_mode_destroy_dumb destroy{handle};
+      drmIoctl(fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+      throw;
+    }
+}
+
+DumbBuffer::~DumbBuffer()
+{
+  munmap(pixels, size);
+  drmModeRmFB(fd, fb);
+  drm_mode_destroy_dumb destroy{handle};
+  drmIoctl(fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+}
+
+uint32_t DumbBuffer::getFb() const
+{
+  return fb;
+}
+
+uint32_t DumbBuffer::getWidth() const
+{
+  return width;
+}
+
+uint32_t DumbBuffer::getHeight() const
+{
+  return height;
+}
+
+uint32_t DumbBuffer::getStride() const
+{
+  return stride;
+}
+
+void *DumbBuffer::getPixels() const
+{
+  return pixels;
+}
@@ -0,0 +1,55 @@
+#include <drm_fourcc.h>
+
+#include "modeset/DumbSurface.hpp"
+
+DumbSurface::DumbSurface(int fd, uint32_t width, uint32_t height)
+  : buffers{std::make_unique<DumbBuffer>(fd, width, height, DRM_FORMAT_XRGB8888),
+	    std::make_unique<DumbBuffer>(fd, width, height, DRM_FORMAT_XRGB8888)},
+    front(NONE),
+    pending(NONE),
+    bufferFrames{0, 0},
+    frameCount(0)
+{
+}
+
+DumbBuffer &DumbSurface::getBackBuffer()
+{
+  return *buffers[front == 0 ? 1 : 0];
+}
+
+unsigned int DumbSurface::getBufferAge()
+{
+  unsigned int bufferFrame(bufferFrames[front == 0 ? 1 : 0]);
+
+  return bufferFrame ? frameCount + 1 - bufferFrame : 0;
+}
+
+void DumbSurface::beginFrame(pixel::Region const &)
+{
+}
+
+uint32_t DumbSurface::lockFrontBuffer(pixel::Region const &)
+{
+  pending = front == 0 ? 1 : 0;
+  bufferFrames[static_cast<std::size_t>(pending)] = ++frameCount;
+  return buffers[static_cast<std::size_t>(pending)]->getFb();
+}
+
+void DumbSurface::releasePendingBuffer()
+{
+  pending = NONE;
+}
+
+void DumbSurface::onPageFlip()
+{
+  if (pending != NONE)
+    {
+      front = pending;
+      pending = NONE;
+    }
+}
+
+unsigned int DumbSurface::getAddFbCount() const
+{
+  return static_cast<unsigned int>(buffers.size());
+}
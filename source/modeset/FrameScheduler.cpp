@@ -0,0 +1,115 @@
+#include <algorithm>
+
+#include "modeset/FrameScheduler.hpp"
+
+namespace
+{
+  constexpr std::chrono::nanoseconds MIN_SAFETY_MARGIN = std::chrono::microseconds(500);
+}
+
+FrameScheduler::FrameScheduler(std::chrono::nanoseconds refreshPeriod)
+  : refreshPeriod(refreshPeriod),
+    history{},
+    historyIndex(0),
+    historyCount(0),
+    safetyMargin(MIN_SAFETY_MARGIN),
+    lastVblank(),
+    renderStart(),
+    targetVblank(),
+    repaintScheduled(false),
+    frameInFlight(false),
+    missedFrameCount(0)
+{
+}
+
+void FrameScheduler::scheduleRepaint()
+{
+  repaintScheduled = true;
+}
+
+bool FrameScheduler::isRepaintScheduled() const
+{
+  return repaintScheduled;
+}
+
+FrameScheduler::Clock::time_point FrameScheduler::getNextVblank(Clock::time_point now) const
+{
+  // no flip yet, we have nothing to align on
+  if (lastVblank == Clock::time_point())
+    return now;
+
+  std::chrono::nanoseconds budget(predictRenderTime() + safetyMargin);
+  Clock::time_point vblank(lastVblank + refreshPeriod);
+
+  // skip the vblanks we can't make anymore
+  if (vblank < now + budget)
+    vblank += refreshPeriod * ((now + budget - vblank) / refreshPeriod + 1);
+  return vblank;
+}
+
+FrameScheduler::Clock::time_point FrameScheduler::getRenderStart(Clock::time_point now) const
+{
+  if (!repaintScheduled)
+    return Clock::time_point::max();
+  if (lastVblank == Clock::time_point())
+    return now;
+  return getNextVblank(now) - predictRenderTime() - safetyMargin;
+}
+
+void FrameScheduler::onRenderStart(Clock::time_point now)
+{
+  repaintScheduled = false;
+  frameInFlight = true;
+  renderStart = now;
+  targetVblank = getNextVblank(now);
+}
+
+void FrameScheduler::onRenderEnd(Clock::time_point now)
+{
+  history[historyIndex] = std::chrono::duration_cast<std::chrono::nanoseconds>(now - renderStart);
+  historyIndex = (historyIndex + 1) % HISTORY_SIZE;
+  historyCount = std::min(historyCount + 1, HISTORY_SIZE);
+}
+
+void FrameScheduler::onPageFlip(Clock::time_point vblank)
+{
+  if (frameInFlight && lastVblank != Clock::time_point())
+    {
+      // the cpu side of the render time doesn't account for the gpu, so misses widen the margin
+      // and hits slowly bring it back down
+      if (vblank > targetVblank + refreshPeriod / 2)
+	{
+	  ++missedFrameCount;
+	  safetyMargin = std::min(safetyMargin * 2, refreshPeriod / 2);
+	}
+      else
+	{
+	  safetyMargin = std::max(safetyMargin - safetyMargin / 16, MIN_SAFETY_MARGIN);
+	}
+    }
+  frameInFlight = false;
+  lastVblank = vblank;
+}
+
+std::chrono::nanoseconds FrameScheduler::predictRenderTime() const
+{
+  if (!historyCount)
+    return refreshPeriod / 2;
+
+  // 90th percentile of the recent frames, so that a single slow frame doesn't make us start early forever
+  std::array<std::chrono::nanoseconds, HISTORY_SIZE> sorted(history);
+  std::size_t rank = historyCount * 9 / 10;
+
+  std::nth_element(sorted.begin(), sorted.begin() + static_cast<long>(rank), sorted.begin() + static_cast<long>(historyCount));
+  return sorted[rank];
+}
+
+std::chrono::nanoseconds FrameScheduler::getRefreshPeriod() const
+{
+  return refreshPeriod;
+}
+
+unsigned int FrameScheduler::getMissedFrameCount() const
+{
+  return missedFrameCount;
+}
@@ -0,0 +1,224 @@
+#include <errno.h>
+#include <string.h>
+#include <string>
+#include <xf86drmMode.h>
+#include <drm_fourcc.h>
+#include <GLES3/gl3.h>
+
+#include "modeset/GbmSurface.hpp"
+#include "Exception.hpp"
+
+GbmSurface::GbmSurface(int fd, struct gbm_device *gbmDevice, EGLDisplay eglDisplay, EGLConfig eglConfig,
+		       uint32_t width, uint32_t height, std::vector<uint64_t> const &modifiers)
+  : fd(fd),
+    eglDisplay(eglDisplay),
+    width(width),
+    height(height),
+    gbmSurface(nullptr),
+    eglSurface(EGL_NO_SURFACE),
+    explicitModifiers(false),
+    modifier(DRM_FORMAT_MOD_INVALID),
+    hasBufferAge(false),
+    setDamageRegion(nullptr),
+    swapBuffersWithDamage(nullptr),
+    currentBo(nullptr),
+    pendingBo(nullptr),
+    addFbCount(0)
+{
+  // create the GBM and EGL surface, older drivers don't implement modifiers and only take the usage flags
+  if (!modifiers.empty())
+    {
+      gbmSurface = gbm_surface_create_with_modifiers(gbmDevice,
+						     width,
+						     height,
+						     GBM_FORMAT_XRGB8888,
+						     modifiers.data(),
+						     static_cast<unsigned int>(modifiers.size()));
+      explicitModifiers = gbmSurface != nullptr;
+    }
+  if (!gbmSurface)
+    gbmSurface = gbm_surface_create(gbmDevice,
+				    width,
+				    height,
+				    GBM_FORMAT_XRGB8888,
+				    GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING);
+  if (!gbmSurface)
+    {
+      throw ModeSettingError("Cannot create gbm surface");
+    }
+  eglSurface = eglCreateWindowSurface(eglDisplay, eglConfig, gbmSurface, nullptr);
+  if (eglSurface == EGL_NO_SURFACE)
+    {
+      gbm_surface_destroy(gbmSurface);
+      throw ModeSettingError("Cannot create EGL surface");
+    }
+
+  // partial repaints need the buffer age, the damage hints let the driver skip work on the rest
+  std::string extensions(eglQueryString(eglDisplay, EGL_EXTENSIONS));
+  hasBufferAge = extensions.find("EGL_EXT_buffer_age") != std::string::npos;
+  if (extensions.find("EGL_KHR_partial_update") != std::string::npos)
+    setDamageRegion = reinterpret_cast<PFNEGLSETDAMAGEREGIONKHRPROC>(eglGetProcAddress("eglSetDamageRegionKHR"));
+  if (extensions.find("EGL_KHR_swap_buffers_with_damage") != std::string::npos)
+    swapBuffersWithDamage = reinterpret_cast<PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC>(eglGetProcAddress("eglSwapBuffersWithDamageKHR"));
+  else if (extensions.find("EGL_EXT_swap_buffers_with_damage") != std::string::npos)
+    swapBuffersWithDamage = reinterpret_cast<PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC>(eglGetProcAddress("eglSwapBuffersWithDamageEXT"));
+}
+
+GbmSurface::~GbmSurface()
+{
+  if (currentBo)
+    {
+      gbm_surface_release_buffer(gbmSurface, currentBo);
+    }
+
+  // destroying the surface destroys its buffers, which removes their framebuffers
+  eglDestroySurface(eglDisplay, eglSurface);
+  gbm_surface_destroy(gbmSurface);
+}
+
+void GbmSurface::makeCurrent(EGLContext eglContext)
+{
+  eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext);
+  glViewport(0, 0, static_cast<GLsizei>(width), static_cast<GLsizei>(height));
+}
+
+unsigned int GbmSurface::getBufferAge()
+{
+  EGLint age(0);
+
+  // the surface must be current
+  if (!hasBufferAge || !eglQuerySurface(eglDisplay, eglSurface, EGL_BUFFER_AGE_EXT, &age))
+    return 0;
+  return static_cast<unsigned int>(age);
+}
+
+void GbmSurface::beginFrame(pixel::Region const &repaint)
+{
+  if (setDamageRegion)
+    {
+      std::vector<EGLint> rects(toEglRects(repaint));
+
+      setDamageRegion(eglDisplay, eglSurface, rects.data(), static_cast<EGLint>(rects.size() / 4));
+    }
+}
+
+uint32_t GbmSurface::lockFrontBuffer(pixel::Region const &damage)
+{
+  if (swapBuffersWithDamage)
+    {
+      std::vector<EGLint> rects(toEglRects(damage));
+
+      swapBuffersWithDamage(eglDisplay, eglSurface, rects.data(), static_cast<EGLint>(rects.size() / 4));
+    }
+  else
+    {
+      eglSwapBuffers(eglDisplay, eglSurface);
+    }
+  struct gbm_bo *bo = gbm_surface_lock_front_buffer(gbmSurface);
+  uint32_t fb;
+
+  // no buffer when the swap failed or every buffer of the surface is still locked
+  if (!bo)
+    throw ModeSettingError("Cannot lock gbm front buffer");
+  try
+    {
+      fb = getFramebuffer(bo);
+    }
+  catch (ModeSettingError const &)
+    {
+      gbm_surface_release_buffer(gbmSurface, bo);
+      throw;
+    }
+  pendingBo = bo;
+  return fb;
+}
+
+void GbmSurface::releasePendingBuffer()
+{
+  gbm_surface_release_buffer(gbmSurface, pendingBo);
+  pendingBo = nullptr;
+}
+
+void GbmSurface::onPageFlip()
+{
+  // the previous buffer left the screen, give it back to the surface
+  if (pendingBo)
+    {
+      if (currentBo)
+	{
+	  gbm_surface_release_buffer(gbmSurface, currentBo);
+	}
+      currentBo = pendingBo;
+      pendingBo = nullptr;
+    }
+}
+
+unsigned int GbmSurface::getAddFbCount() const
+{
+  return addFbCount;
+}
+
+uint64_t GbmSurface::getModifier() const
+{
+  return modifier;
+}
+
+std::vector<EGLint> GbmSurface::toEglRects(pixel::Region const &region) const
+{
+  std::vector<EGLint> rects;
+
+  for (pixel::Rect const &rect : region.getRects())
+    {
+      rects.push_back(rect.x);
+      rects.push_back(static_cast<EGLint>(height) - rect.y - rect.height);
+      rects.push_back(rect.width);
+      rects.push_back(rect.height);
+    }
+  return rects;
+}
+
+void GbmSurface::destroyBoFramebuffer(struct gbm_bo *, void *data)
+{
+  BoFramebuffer *boFramebuffer = static_cast<BoFramebuffer *>(data);
+
+  drmModeRmFB(boFramebuffer->fd, boFramebuffer->fbId);
+  delete boFramebuffer;
+}
+
+uint32_t GbmSurface::getFramebuffer(struct gbm_bo *bo)
+{
+  // the surface cycles through a few buffers, so the framebuffer is only created the first time we see one
+  if (BoFramebuffer *boFramebuffer = static_cast<BoFramebuffer *>(gbm_bo_get_user_data(bo)))
+    return boFramebuffer->fbId;
+
+  // tiled and compressed layouts may put auxiliary data in extra planes
+  uint32_t handles[4] = {};
+  uint32_t strides[4] = {};
+  uint32_t offsets[4] = {};
+  uint64_t modifiers[4] = {};
+  int planeCount = explicitModifiers ? gbm_bo_get_plane_count(bo) : 1;
+  uint32_t fb;
+  int ret;
+
+  if (explicitModifiers)
+    modifier = gbm_bo_get_modifier(bo);
+  for (int plane = 0; plane < planeCount && plane < 4; ++plane)
+    {
+      handles[plane] = gbm_bo_get_handle_for_plane(bo, plane).u32;
+      strides[plane] = gbm_bo_get_stride_for_plane(bo, plane);
+      offsets[plane] = gbm_bo_get_offset(bo, plane);
+      modifiers[plane] = modifier;
+    }
+  if (explicitModifiers)
+    ret = drmModeAddFB2WithModifiers(fd, width, height, DRM_FORMAT_XRGB8888,
+				     handles, strides, offsets, modifiers, &fb, DRM_MODE_FB_MODIFIERS);
+  else
+    ret = drmModeAddFB2(fd, width, height, DRM_FORMAT_XRGB8888, handles, strides, offsets, &fb, 0);
+  if (ret)
+    {
+      throw ModeSettingError(std::string("Cannot add framebuffer: ") + strerror(errno));
+    }
+  ++addFbCount;
+  gbm_bo_set_user_data(bo, new BoFramebuffer{fd, fb}, &GbmSurface::destroyBoFramebuffer);
+  return fb;
+}
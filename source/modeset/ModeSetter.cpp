@@ -2,166 +2,334 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
 #include <iostream>
+#include <memory>
+#include <drm_fourcc.h>
 
 #include "modeset/ModeSetter.hpp"
+#include "modeset/GbmSurface.hpp"
+#include "modeset/DumbSurface.hpp"
 #include "Exception.hpp"
 
-ModeSetter::Drm::Drm()
+namespace
 {
-  // TODO find card1 with proper scan
-  fd = open("/dev/dri/card1", O_RDWR | O_CLOEXEC);
+  bool hasConnectedConnector(int fd)
+  {
+    drmModeRes *res = drmModeGetResources(fd);
+    bool connected = false;
+
+    if (!res)
+      return false;
+    for (int i = 0; i < res->count_connectors && !connected; ++i)
+      {
+	drmModeConnector *conn = drmModeGetConnector(fd, res->connectors[i]);
+
+	connected = conn && conn->connection == DRM_MODE_CONNECTED && conn->count_modes;
+	drmModeFreeConnector(conn);
+      }
+    drmModeFreeResources(res);
+    return connected;
+  }
+}
+
+ModeSetter::Drm::Drm(Backend backend)
+  : fd(-1)
+{
+  // take the first card that can drive a screen, render only devices have no connectors
+  // and virtual drivers like vkms may be any card
+  for (int card = 0; card < 16 && fd < 0; ++card)
+    {
+      std::string path("/dev/dri/card" + std::to_string(card));
+      uint64_t dumbBuffer = 0;
+
+      fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+      if (fd < 0)
+	continue;
+      if (drmSetClientCap(fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) ||
+	  drmSetClientCap(fd, DRM_CLIENT_CAP_ATOMIC, 1) ||
+	  (backend == Backend::Software && (drmGetCap(fd, DRM_CAP_DUMB_BUFFER, &dumbBuffer) || !dumbBuffer)) ||
+	  !hasConnectedConnector(fd))
+	{
+	  close(fd);
+	  fd = -1;
+	}
+    }
   if (fd < 0)
     {
-      throw ModeSettingError("/dev/dri/card1: no such file or directory");
+      throw ModeSettingError("No drm device with atomic modesetting and a connected screen");
     }
 
-  drmModeRes *res = drmModeGetResources(fd);
-  if (!res)
+  // frame scheduling compares flip timestamps against the monotonic clock
+  uint64_t monotonic = 0;
+  if (drmGetCap(fd, DRM_CAP_TIMESTAMP_MONOTONIC, &monotonic) || !monotonic)
     {
-      throw ModeSettingError("Cannot get drm resource");
+      std::cerr << "warning: page flip timestamps are not monotonic, frame scheduling will be off" << std::endl;
     }
+}
+
+ModeSetter::Drm::~Drm()
+{
+  close(fd);
+}
 
-  drmModeConnector *conn = nullptr;
-  for (int i = 0; i < res->count_connectors; ++i)
+ModeSetter::Gbm::Gbm(int fd)
+{
+  gbmDevice = gbm_create_device(fd);
+  if (!gbmDevice)
     {
-      conn = drmModeGetConnector(fd, res->connectors[i]);
-	if (conn && conn->connection == DRM_MODE_CONNECTED)
-	  break;
-      drmModeFreeConnector(conn);
-      conn = nullptr;
+      throw ModeSettingError("Cannot create gbm device");
     }
-  if (!conn)
+  eglDisplay = eglGetDisplay(gbmDevice);
+  if (!eglInitialize(eglDisplay, nullptr, nullptr))
     {
-      throw ModeSettingError("Connector not found");
+      gbm_device_destroy(gbmDevice);
+      throw ModeSettingError("Cannot initialize EGL");
     }
 
-  modeInfo = conn->modes[0];
-  connectorId = conn->connector_id;
+  // create an OpenGL context
+  // the renderer is written against GLES 3, as are its shaders and the EGLImage entry points
+  eglBindAPI(EGL_OPENGL_ES_API);
+  EGLint attributes[] = {
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
+    EGL_RED_SIZE, 8,
+    EGL_GREEN_SIZE, 8,
+    EGL_BLUE_SIZE, 8,
+    EGL_NONE};
+  EGLint contextAttributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_NONE};
+  EGLint numConfig;
+  eglChooseConfig(eglDisplay, attributes, &eglConfig, 1, &numConfig);
+  eglContext = eglCreateContext(eglDisplay, eglConfig, EGL_NO_CONTEXT, contextAttributes);
+  if (eglContext == EGL_NO_CONTEXT)
+    {
+      eglTerminate(eglDisplay);
+      gbm_device_destroy(gbmDevice);
+      throw ModeSettingError("Cannot create EGL context");
+    }
+}
 
-  drmModeEncoder *enc = nullptr;
-  if (conn->encoder_id)
+ModeSetter::ModeSetter(Backend backend)
+  : backend(backend),
+    drm(backend),
+    gbm(),
+    planeAllocator(drm.fd)
+{
+  try
     {
-      enc = drmModeGetEncoder(fd, conn->encoder_id);
+      if (backend == Backend::Gl)
+	gbm.emplace(drm.fd);
+      createOutputs();
     }
-  else
+  catch (...)
     {
-      throw ModeSettingError("Encoder not found");
+      outputs.clear();
+      if (gbm)
+	{
+	  eglDestroyContext(gbm->eglDisplay, gbm->eglContext);
+	  eglTerminate(gbm->eglDisplay);
+	  gbm_device_destroy(gbm->gbmDevice);
+	}
+      throw;
     }
+  // make the context current so that assets can be uploaded right away
+  if (gbm)
+    makeCurrent(*outputs.front());
+}
 
-  if (enc->crtc_id)
+ModeSetter::~ModeSetter()
+{
+  // the kernel still references the pending buffers until the flips complete
+  try
     {
-      crtc = drmModeGetCrtc(fd, enc->crtc_id);
+      waitPageFlips();
     }
-  else
+  catch (ModeSettingError const &e)
     {
-      throw ModeSettingError("CRTC not found");
+      std::cerr << "swallowing error: " << e.what() << std::endl;
     }
+  if (gbm)
+    eglMakeCurrent(gbm->eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  outputs.clear();
 
-  // clean up
-  drmModeFreeEncoder(enc);
-  drmModeFreeConnector(conn);
-  drmModeFreeResources(res);
+  if (gbm)
+    {
+      eglDestroyContext(gbm->eglDisplay, gbm->eglContext);
+      eglTerminate(gbm->eglDisplay);
+      gbm_device_destroy(gbm->gbmDevice);
+    }
 }
 
-ModeSetter::Gbm::Gbm(int fd, uint16_t width, uint16_t height)
+void ModeSetter::createOutputs()
 {
-  gbmDevice = gbm_create_device(fd);
-  eglDisplay = eglGetDisplay(gbmDevice);
-  eglInitialize(eglDisplay, nullptr, nullptr);
+  drmModeRes *res = drmModeGetResources(drm.fd);
+  if (!res)
+    {
+      throw ModeSettingError("Cannot get drm resource");
+    }
 
-  // create an OpenGL context
-  eglBindAPI(EGL_OPENGL_API);
-  EGLint attributes[] = {
-    EGL_RED_SIZE, 8,
-    EGL_GREEN_SIZE, 8,
-    EGL_BLUE_SIZE, 8,
-    EGL_NONE};
-  EGLConfig config;
-  EGLint numConfig;
-  eglChooseConfig(eglDisplay, attributes, &config, 1, &numConfig);
-  eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, nullptr);
-
-  // create the GBM and EGL surface
-  gbmSurface = gbm_surface_create(gbmDevice,
-				  height,
-				  width,
-				  GBM_BO_FORMAT_XRGB8888,
-				  GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING);
-  eglSurface = eglCreateWindowSurface(eglDisplay, config, gbmSurface, nullptr);
-  eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext);
+  std::vector<uint32_t> usedCrtcs;
+  Output::SurfaceFactory createSurface;
+
+  if (gbm)
+    {
+      // explicit modifiers are useless if framebuffers can't be created with them
+      uint64_t addFbModifiers = 0;
+
+      if (drmGetCap(drm.fd, DRM_CAP_ADDFB2_MODIFIERS, &addFbModifiers))
+	addFbModifiers = 0;
+      createSurface = [this, addFbModifiers](uint32_t width, uint32_t height, PlaneAllocator::Plane const &primaryPlane)
+	-> std::unique_ptr<ScanoutSurface>
+	{
+	  return std::make_unique<GbmSurface>(drm.fd, gbm->gbmDevice, gbm->eglDisplay, gbm->eglConfig, width, height,
+					      addFbModifiers ? primaryPlane.getModifiers(DRM_FORMAT_XRGB8888) : std::vector<uint64_t>());
+	};
+    }
+  else
+    createSurface = [this](uint32_t width, uint32_t height, PlaneAllocator::Plane const &) -> std::unique_ptr<ScanoutSurface>
+      {
+	return std::make_unique<DumbSurface>(drm.fd, width, height);
+      };
+
+  try
+    {
+      for (int i = 0; i < res->count_connectors; ++i)
+	{
+	  drmModeConnector *conn = drmModeGetConnector(drm.fd, res->connectors[i]);
+
+	  if (!conn || conn->connection != DRM_MODE_CONNECTED || !conn->count_modes)
+	    {
+	      drmModeFreeConnector(conn);
+	      continue;
+	    }
+
+	  // prefer the crtc the connector is already driven by, otherwise take the first free compatible one
+	  uint32_t crtcId = 0;
+	  int crtcIndex = 0;
+	  PlaneAllocator::Plane *primaryPlane = nullptr;
+	  std::vector<uint32_t> encoderIds(conn->encoders, conn->encoders + conn->count_encoders);
+
+	  if (conn->encoder_id)
+	    encoderIds.insert(encoderIds.begin(), conn->encoder_id);
+	  for (uint32_t encoderId : encoderIds)
+	    {
+	      drmModeEncoder *enc = drmModeGetEncoder(drm.fd, encoderId);
+
+	      if (!enc)
+		continue;
+	      for (int index = 0; index < res->count_crtcs && !crtcId; ++index)
+		{
+		  uint32_t candidate = res->crtcs[index];
+
+		  if (!(enc->possible_crtcs & (1u << index)) ||
+		      std::find(usedCrtcs.begin(), usedCrtcs.end(), candidate) != usedCrtcs.end() ||
+		      (encoderId == conn->encoder_id && enc->crtc_id && enc->crtc_id != candidate))
+		    continue;
+		  if ((primaryPlane = planeAllocator.reserve(PlaneAllocator::Type::Primary, candidate, index, DRM_FORMAT_XRGB8888)))
+		    {
+		      crtcId = candidate;
+		      crtcIndex = index;
+		    }
+		}
+	      drmModeFreeEncoder(enc);
+	      if (crtcId)
+		break;
+	    }
+
+	  if (crtcId)
+	    {
+	      try
+		{
+		  outputs.push_back(std::make_unique<Output>(drm.fd, *conn, crtcId, crtcIndex,
+							     planeAllocator, *primaryPlane, createSurface));
+		  usedCrtcs.push_back(crtcId);
+		}
+	      catch (ModeSettingError const &e)
+		{
+		  planeAllocator.release(primaryPlane);
+		  std::cerr << "connector " << conn->connector_id << ": " << e.what() << std::endl;
+		}
+	    }
+	  else
+	    {
+	      std::cerr << "connector " << conn->connector_id << ": no free CRTC" << std::endl;
+	    }
+	  drmModeFreeConnector(conn);
+	}
+    }
+  catch (...)
+    {
+      drmModeFreeResources(res);
+      throw;
+    }
+
+  // clean up
+  drmModeFreeResources(res);
+
+  if (outputs.empty())
+    {
+      throw ModeSettingError("Connector not found");
+    }
 }
 
-ModeSetter::ModeSetter()
-  : drm(),
-    gbm(drm.fd, drm.modeInfo.vdisplay, drm.modeInfo.hdisplay),
-    previousBo(nullptr),
-    previousFb(0)
+void ModeSetter::makeCurrent(Output &output)
 {
+  if (!gbm)
+    {
+      throw ModeSettingError("No GL context with the software backend");
+    }
+  static_cast<GbmSurface &>(output.getSurface()).makeCurrent(gbm->eglContext);
 }
 
-ModeSetter::~ModeSetter()
+void ModeSetter::handleEvents()
 {
-  // set the previous crtc
-  drmModeSetCrtc(drm.fd,
-		 drm.crtc->crtc_id,
-		 drm.crtc->buffer_id,
-		 drm.crtc->x,
-		 drm.crtc->y,
-		 &drm.connectorId, 1, &drm.crtc->mode);
-  drmModeFreeCrtc(drm.crtc);
+  drmEventContext eventContext{};
 
-  if (previousBo)
+  eventContext.version = 2;
+  eventContext.page_flip_handler = &ModeSetter::pageFlipHandler;
+  if (drmHandleEvent(drm.fd, &eventContext))
     {
-      drmModeRmFB(drm.fd, previousFb);
-      gbm_surface_release_buffer(gbm.gbmSurface, previousBo);
+      throw ModeSettingError("Cannot handle drm events");
     }
+}
 
-  eglDestroySurface(gbm.eglDisplay, gbm.eglSurface);
-  eglDestroyContext(gbm.eglDisplay, gbm.eglContext);
-  eglTerminate(gbm.eglDisplay);
-  gbm_device_destroy(gbm.gbmDevice);
+void ModeSetter::waitPageFlips()
+{
+  while (std::any_of(outputs.begin(), outputs.end(), [](auto const &output) { return output->isCommitPending(); }))
+    {
+      pollfd pollFd{drm.fd, POLLIN, 0};
 
-  close(drm.fd);
+      if (poll(&pollFd, 1, -1) < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  throw ModeSettingError(std::string("Cannot poll drm fd: ") + strerror(errno));
+	}
+      handleEvents();
+    }
 }
 
-void ModeSetter::swapBuffers()
+void ModeSetter::pageFlipHandler(int, unsigned int sequence, unsigned int sec, unsigned int usec, void *data)
 {
-  eglSwapBuffers(gbm.eglDisplay, gbm.eglSurface);
-  struct gbm_bo *bo = gbm_surface_lock_front_buffer(gbm.gbmSurface);
-  uint32_t handle = gbm_bo_get_handle(bo).u32;
-  uint32_t stride = gbm_bo_get_stride(bo);
-  uint32_t fb;
-  drmModeAddFB(drm.fd,
-	       drm.modeInfo.hdisplay,
-	       drm.modeInfo.vdisplay,
-	       24, 32, stride, handle, &fb);
-  int ret = drmModeSetCrtc(drm.fd,
-			   drm.crtc->crtc_id,
-			   fb,
-			   0,
-			   0,
-			   &drm.connectorId, 1, &drm.modeInfo);
-  if (ret != 0)
-    {
-      throw ModeSettingError("Cannot set CRTC");
-    }
-
-  if (previousBo) {
-    drmModeRmFB(drm.fd, previousFb);
-    gbm_surface_release_buffer(gbm.gbmSurface, previousBo);
-  }
+  static_cast<Output *>(data)->onPageFlip({sequence, sec, usec});
+}
 
-  previousBo = bo;
-  previousFb = fb;
+ModeSetter::Backend ModeSetter::getBackend() const
+{
+  return backend;
 }
 
-int ModeSetter::getScreenWidth() const
+int ModeSetter::getFd() const
 {
-  return drm.modeInfo.vdisplay;
+  return drm.fd;
 }
 
-int ModeSetter::getScreenHeight() const
+std::vector<std::unique_ptr<Output>> const &ModeSetter::getOutputs() const
 {
-  return drm.modeInfo.hdisplay;
+  return outputs;
 }
@@ -0,0 +1,472 @@
+#include <errno.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <drm_fourcc.h>
+
+#include "modeset/Output.hpp"
+#include "modeset/DrmProperty.hpp"
+#include "pixel/Blit.hpp"
+#include "Exception.hpp"
+
+namespace
+{
+  drmModeModeInfo const &selectMode(drmModeConnector const &connector)
+  {
+    if (!connector.count_modes)
+      {
+	throw ModeSettingError("Connector has no mode");
+      }
+    for (int i = 0; i < connector.count_modes; ++i)
+      if (connector.modes[i].type & DRM_MODE_TYPE_PREFERRED)
+	return connector.modes[i];
+    return connector.modes[0];
+  }
+
+  std::chrono::nanoseconds getRefreshPeriod(drmModeModeInfo const &modeInfo)
+  {
+    // the pixel clock is in kHz, vrefresh is rounded
+    if (!modeInfo.clock || !modeInfo.htotal || !modeInfo.vtotal)
+      return std::chrono::nanoseconds(1000000000 / (modeInfo.vrefresh ? modeInfo.vrefresh : 60));
+    return std::chrono::nanoseconds(uint64_t(modeInfo.htotal) * modeInfo.vtotal * 1000000 / modeInfo.clock);
+  }
+}
+
+Output::Output(int fd,
+	       drmModeConnector const &connector,
+	       uint32_t crtcId,
+	       int crtcIndex,
+	       PlaneAllocator &planeAllocator,
+	       PlaneAllocator::Plane &primaryPlane,
+	       SurfaceFactory const &createSurface)
+  : fd(fd),
+    connectorId(connector.connector_id),
+    crtcId(crtcId),
+    crtcIndex(crtcIndex),
+    planeAllocator(planeAllocator),
+    primaryPlane(primaryPlane),
+    modeInfo(selectMode(connector)),
+    savedCrtc(nullptr),
+    modeBlobId(0),
+    modeSet(false),
+    commitPending(false),
+    frameCommitted(false),
+    queuedFb(0),
+    cursor{},
+    frameScheduler(getRefreshPeriod(modeInfo)),
+    lastPageFlip{0, 0, 0},
+    pageFlipCount(0)
+{
+  connectorProperties.crtcId = drmProperty::getId(fd, connectorId, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID");
+  crtcProperties.modeId = drmProperty::getId(fd, crtcId, DRM_MODE_OBJECT_CRTC, "MODE_ID");
+  crtcProperties.active = drmProperty::getId(fd, crtcId, DRM_MODE_OBJECT_CRTC, "ACTIVE");
+
+  surface = createSurface(modeInfo.hdisplay, modeInfo.vdisplay, primaryPlane);
+  damage.add(getScreenRect());
+
+  if (drmModeCreatePropertyBlob(fd, &modeInfo, sizeof(modeInfo), &modeBlobId))
+    {
+      throw ModeSettingError("Cannot create mode blob");
+    }
+  savedCrtc = drmModeGetCrtc(fd, crtcId);
+}
+
+Output::~Output()
+{
+  // turn the cursor plane off, the legacy restore below only knows about the primary plane
+  if (cursor.plane && modeSet)
+    {
+      drmModeAtomicReq *req = drmModeAtomicAlloc();
+
+      cursor.plane->disable(req);
+      drmModeAtomicCommit(fd, req, 0, nullptr);
+      drmModeAtomicFree(req);
+    }
+  planeAllocator.release(cursor.plane);
+  planeAllocator.release(&primaryPlane);
+
+  // set the previous crtc
+  if (savedCrtc)
+    {
+      drmModeSetCrtc(fd,
+		     savedCrtc->crtc_id,
+		     savedCrtc->buffer_id,
+		     savedCrtc->x,
+		     savedCrtc->y,
+		     &connectorId, 1, &savedCrtc->mode);
+      drmModeFreeCrtc(savedCrtc);
+    }
+  drmModeDestroyPropertyBlob(fd, modeBlobId);
+}
+
+ScanoutSurface &Output::getSurface()
+{
+  return *surface;
+}
+
+pixel::Rect Output::getScreenRect() const
+{
+  return {0, 0, modeInfo.hdisplay, modeInfo.vdisplay};
+}
+
+void Output::addDamage(pixel::Rect const &rect)
+{
+  damage.add(rect.intersect(getScreenRect()));
+  frameScheduler.scheduleRepaint();
+}
+
+void Output::damageAll()
+{
+  addDamage(getScreenRect());
+}
+
+pixel::Region Output::beginFrame()
+{
+  unsigned int age(surface->getBufferAge());
+  pixel::Region repaint(damage);
+
+  // the back buffer misses every change made since it was last on screen
+  if (!age || age > damageHistory.size() + 1)
+    repaint = pixel::Region(getScreenRect());
+  else
+    for (unsigned int i = 0; i + 1 < age; ++i)
+      repaint.add(damageHistory[i]);
+  surface->beginFrame(repaint);
+  return repaint;
+}
+
+void Output::swapBuffers()
+{
+  if (isPageFlipPending())
+    {
+      throw ModeSettingError("Page flip already pending");
+    }
+
+  uint32_t fb = surface->lockFrontBuffer(damage);
+  if (commitPending)
+    {
+      // a cursor update is in flight, the frame goes out with the next commit once it completes
+      queuedFb = fb;
+      queuedDamage = damage;
+    }
+  else
+    {
+      try
+	{
+	  commit(fb, &damage);
+	}
+      catch (ModeSettingError const &)
+	{
+	  dropFrame();
+	  throw;
+	}
+    }
+
+  damageHistory.push_front(damage);
+  // triple buffering at most, older buffers are repainted in full
+  if (damageHistory.size() > 3)
+    damageHistory.pop_back();
+  damage.clear();
+}
+
+void Output::dropFrame()
+{
+  surface->releasePendingBuffer();
+  // the buffer ages don't match the history anymore
+  damageHistory.clear();
+  damageAll();
+}
+
+void Output::commit(uint32_t fb, pixel::Region const *damage)
+{
+  drmModeAtomicReq *req = drmModeAtomicAlloc();
+  uint32_t flags = DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT;
+  bool changed = !modeSet || fb != 0;
+
+  if (!modeSet)
+    {
+      // the first commit also programs the mode
+      drmModeAtomicAddProperty(req, connectorId, connectorProperties.crtcId, crtcId);
+      drmModeAtomicAddProperty(req, crtcId, crtcProperties.modeId, modeBlobId);
+      drmModeAtomicAddProperty(req, crtcId, crtcProperties.active, 1);
+      flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
+    }
+  uint32_t damageBlobId = 0;
+  if (fb)
+    {
+      primaryPlane.set(req, crtcId, fb,
+		       {0, 0, modeInfo.hdisplay, modeInfo.vdisplay},
+		       {0, 0, modeInfo.hdisplay, modeInfo.vdisplay});
+
+      // without damage clips the driver assumes the whole framebuffer changed,
+      // which costs a full upload on drivers that copy or compress the scanout buffer
+      std::vector<drm_mode_rect> clips;
+      if (damage && modeSet && primaryPlane.properties.fbDamageClips)
+	for (pixel::Rect const &rect : damage->getRects())
+	  clips.push_back({rect.x, rect.y, rect.x + rect.width, rect.y + rect.height});
+      if (!clips.empty() &&
+	  !drmModeCreatePropertyBlob(fd, clips.data(), clips.size() * sizeof(drm_mode_rect), &damageBlobId))
+	primaryPlane.setDamage(req, damageBlobId);
+      else if (primaryPlane.properties.fbDamageClips)
+	primaryPlane.setDamage(req, 0);
+    }
+  changed |= addLayer(req, cursor, flags);
+  if (!changed)
+    {
+      // e.g. the hidden cursor moved, there is nothing to flip
+      drmModeAtomicFree(req);
+      return;
+    }
+  // naming the crtc pulls it into the commit even when only a plane changed, so the flip event is guaranteed
+  if (modeSet)
+    drmModeAtomicAddProperty(req, crtcId, crtcProperties.active, 1);
+
+  // the output is passed as user data so that the event handler knows which crtc flipped
+  int ret = drmModeAtomicCommit(fd, req, flags, this);
+  drmModeAtomicFree(req);
+  // the commit holds its own reference to the blob
+  if (damageBlobId)
+    drmModeDestroyPropertyBlob(fd, damageBlobId);
+  if (ret != 0)
+    {
+      throw ModeSettingError(std::string("Cannot commit page flip: ") + strerror(errno));
+    }
+
+  modeSet = true;
+  commitPending = true;
+  frameCommitted = fb != 0;
+}
+
+bool Output::addLayer(drmModeAtomicReq *req, Layer &layer, uint32_t flags)
+{
+  bool added = false;
+
+  if (!layer.plane)
+    return false;
+  if (layer.changed)
+    {
+      int reqCursor = drmModeAtomicGetCursor(req);
+
+      added = true;
+      if (!layer.visible)
+	{
+	  layer.plane->disable(req);
+	}
+      else
+	{
+	  layer.plane->set(req, crtcId, layer.fb, layer.src, layer.dst);
+	  // new plane configurations are validated first, on refusal the layer goes back to composition
+	  if (!planeAllocator.test(req, flags))
+	    {
+	      drmModeAtomicSetCursor(req, reqCursor);
+	      layer.plane->disable(req);
+	      planeAllocator.release(layer.plane);
+	      layer.plane = nullptr;
+	      layer.composited = true;
+	      addDamage({layer.dst.x, layer.dst.y, static_cast<int32_t>(layer.dst.width), static_cast<int32_t>(layer.dst.height)});
+	    }
+	}
+    }
+  else if (layer.moved && layer.visible)
+    {
+      layer.plane->move(req, layer.dst.x, layer.dst.y);
+      added = true;
+    }
+  layer.changed = false;
+  layer.moved = false;
+  return added;
+}
+
+void Output::reserveLayerPlane(Layer &layer, PlaneAllocator::Type type, uint32_t format)
+{
+  if (!layer.plane)
+    layer.plane = planeAllocator.reserve(type, crtcId, crtcIndex, format);
+  layer.composited = !layer.plane;
+  layer.changed = true;
+}
+
+void Output::setCursorImage(uint32_t const *argb, uint32_t width, uint32_t height)
+{
+  uint64_t cursorWidth = 64;
+  uint64_t cursorHeight = 64;
+
+  drmGetCap(fd, DRM_CAP_CURSOR_WIDTH, &cursorWidth);
+  drmGetCap(fd, DRM_CAP_CURSOR_HEIGHT, &cursorHeight);
+  if (width > cursorWidth || height > cursorHeight)
+    {
+      throw ModeSettingError("Cursor image bigger than the hardware cursor");
+    }
+
+  if (!cursorBuffer)
+    {
+      cursorBuffer = std::make_unique<DumbBuffer>(fd,
+						  static_cast<uint32_t>(cursorWidth),
+						  static_cast<uint32_t>(cursorHeight),
+						  DRM_FORMAT_ARGB8888);
+      cursor.fb = cursorBuffer->getFb();
+    }
+
+  // the cursor buffer has a fixed size, the image goes in its top left corner
+  cursorImage.assign(cursorWidth * cursorHeight, 0u);
+  for (uint32_t y = 0; y < height; ++y)
+    std::copy(argb + y * width, argb + (y + 1) * width, cursorImage.begin() + static_cast<long>(y * cursorWidth));
+  pixel::copy(cursorBuffer->getPixels(), cursorBuffer->getStride(),
+	      cursorImage.data(), cursorWidth * sizeof(uint32_t),
+	      cursorBuffer->getWidth(), cursorBuffer->getHeight());
+
+  cursor.src = {0, 0, static_cast<uint32_t>(cursorWidth), static_cast<uint32_t>(cursorHeight)};
+  cursor.dst.width = cursor.src.width;
+  cursor.dst.height = cursor.src.height;
+  cursor.visible = true;
+  reserveLayerPlane(cursor, PlaneAllocator::Type::Cursor, DRM_FORMAT_ARGB8888);
+  if (!cursor.plane)
+    damageCursor();
+  else if (!commitPending && modeSet)
+    commit(0);
+}
+
+void Output::damageCursor()
+{
+  if (!cursor.plane && cursor.visible)
+    addDamage({cursor.dst.x, cursor.dst.y, static_cast<int32_t>(cursor.dst.width), static_cast<int32_t>(cursor.dst.height)});
+}
+
+void Output::moveCursor(int32_t x, int32_t y)
+{
+  // a composited cursor repaints where it was and where it goes, otherwise the position is sent
+  // right away, or with the next commit if one is in flight. Cursor commits don't hold back frames,
+  // a frame rendered meanwhile is queued behind them
+  damageCursor();
+  cursor.dst.x = x;
+  cursor.dst.y = y;
+  cursor.moved = true;
+  if (!cursor.plane)
+    damageCursor();
+  else if (!commitPending && modeSet)
+    commit(0);
+}
+
+void Output::hideCursor()
+{
+  damageCursor();
+  cursor.visible = false;
+  cursor.changed = true;
+  if (cursor.plane && !commitPending && modeSet)
+    commit(0);
+}
+
+bool Output::isCursorOnPlane() const
+{
+  return cursor.visible && !cursor.composited;
+}
+
+bool Output::isCursorVisible() const
+{
+  return cursor.visible;
+}
+
+std::vector<uint32_t> const &Output::getCursorImage() const
+{
+  return cursorImage;
+}
+
+PlaneAllocator::Rect Output::getCursorRect() const
+{
+  return cursor.dst;
+}
+
+void Output::onPageFlip(PageFlip const &pageFlip)
+{
+  commitPending = false;
+  if (frameCommitted)
+    {
+      frameCommitted = false;
+      surface->onPageFlip();
+      lastPageFlip = pageFlip;
+      ++pageFlipCount;
+      frameScheduler.onPageFlip(FrameScheduler::Clock::time_point(std::chrono::seconds(pageFlip.sec) +
+								  std::chrono::microseconds(pageFlip.usec)));
+    }
+
+  // we are called from the drm event handler, don't throw through it
+  if (queuedFb)
+    {
+      // the frame that waited for a cursor update, with the cursor moves made since
+      uint32_t fb(queuedFb);
+
+      queuedFb = 0;
+      try
+	{
+	  commit(fb, &queuedDamage);
+	}
+      catch (ModeSettingError const &e)
+	{
+	  dropFrame();
+	  std::cerr << "queued frame failed: " << e.what() << std::endl;
+	}
+    }
+  else if (cursor.plane && (cursor.moved || cursor.changed))
+    {
+      // cursor moves that happened during the flip go out right away
+      try
+	{
+	  commit(0);
+	}
+      catch (ModeSettingError const &e)
+	{
+	  std::cerr << "cursor update failed: " << e.what() << std::endl;
+	}
+    }
+}
+
+bool Output::isPageFlipPending() const
+{
+  return frameCommitted || queuedFb;
+}
+
+bool Output::isCommitPending() const
+{
+  return commitPending || queuedFb;
+}
+
+Output::PageFlip const &Output::getLastPageFlip() const
+{
+  return lastPageFlip;
+}
+
+unsigned int Output::getPageFlipCount() const
+{
+  return pageFlipCount;
+}
+
+unsigned int Output::getAddFbCount() const
+{
+  return surface->getAddFbCount() + (cursorBuffer ? 1 : 0);
+}
+
+FrameScheduler &Output::getFrameScheduler()
+{
+  return frameScheduler;
+}
+
+uint32_t Output::getConnectorId() const
+{
+  return connectorId;
+}
+
+uint32_t Output::getCrtcId() const
+{
+  return crtcId;
+}
+
+int Output::getWidth() const
+{
+  return modeInfo.hdisplay;
+}
+
+int Output::getHeight() const
+{
+  return modeInfo.vdisplay;
+}
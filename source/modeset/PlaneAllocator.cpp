@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <cstring>
+#include <drm_fourcc.h>
+
+#include "modeset/PlaneAllocator.hpp"
+#include "modeset/DrmProperty.hpp"
+#include "Exception.hpp"
+
+namespace
+{
+  // Decodes the IN_FORMATS blob: a format list and modifiers that each apply to a window of 64 formats
+  std::vector<std::pair<uint32_t, uint64_t>> readFormatModifiers(int fd, uint32_t planeId)
+  {
+    std::vector<std::pair<uint32_t, uint64_t>> formatModifiers;
+    uint32_t blobId = uint32_t(drmProperty::getValue(fd, planeId, DRM_MODE_OBJECT_PLANE, "IN_FORMATS"));
+    drmModePropertyBlobRes *blob = blobId ? drmModeGetPropertyBlob(fd, blobId) : nullptr;
+
+    if (!blob)
+      return formatModifiers;
+
+    char const *data = static_cast<char const *>(blob->data);
+    drm_format_modifier_blob header;
+    std::memcpy(&header, data, sizeof(header));
+    for (uint32_t i = 0; i < header.count_modifiers; ++i)
+      {
+	drm_format_modifier modifier;
+	std::memcpy(&modifier, data + header.modifiers_offset + i * sizeof(modifier), sizeof(modifier));
+
+	for (uint32_t bit = 0; bit < 64; ++bit)
+	  if (modifier.formats & (1ull << bit))
+	    {
+	      uint32_t format;
+	      std::memcpy(&format, data + header.formats_offset + (modifier.offset + bit) * sizeof(format), sizeof(format));
+	      formatModifiers.emplace_back(format, modifier.modifier);
+	    }
+      }
+    drmModeFreePropertyBlob(blob);
+    return formatModifiers;
+  }
+}
+
+PlaneAllocator::PlaneAllocator(int fd)
+  : fd(fd)
+{
+  drmModePlaneRes *planeRes = drmModeGetPlaneResources(fd);
+  if (!planeRes)
+    {
+      throw ModeSettingError("Cannot get drm plane resource");
+    }
+
+  try
+    {
+      for (uint32_t i = 0; i < planeRes->count_planes; ++i)
+	{
+	  drmModePlane *drmPlane = drmModeGetPlane(fd, planeRes->planes[i]);
+
+	  if (!drmPlane)
+	    continue;
+
+	  Plane plane{};
+	  plane.id = drmPlane->plane_id;
+	  plane.type = Type(drmProperty::getValue(fd, plane.id, DRM_MODE_OBJECT_PLANE, "type"));
+	  plane.possibleCrtcs = drmPlane->possible_crtcs;
+	  plane.formats.assign(drmPlane->formats, drmPlane->formats + drmPlane->count_formats);
+	  drmModeFreePlane(drmPlane);
+	  plane.formatModifiers = readFormatModifiers(fd, plane.id);
+
+	  plane.properties.fbId = drmProperty::getId(fd, plane.id, DRM_MODE_OBJECT_PLANE, "FB_ID");
+	  plane.properties.crtcId = drmProperty::getId(fd, plane.id, DRM_MODE_OBJECT_PLANE, "CRTC_ID");
+	  plane.properties.srcX = drmProperty::getId(fd, plane.id, DRM_MODE_OBJECT_PLANE, "SRC_X");
+	  plane.properties.srcY = drmProperty::getId(fd, plane.id, DRM_MODE_OBJECT_PLANE, "SRC_Y");
+	  plane.properties.srcW = drmProperty::getId(fd, plane.id, DRM_MODE_OBJECT_PLANE, "SRC_W");
+	  plane.properties.srcH = drmProperty::getId(fd, plane.id, DRM_MODE_OBJECT_PLANE, "SRC_H");
+	  plane.properties.crtcX = drmProperty::getId(fd, plane.id, DRM_MODE_OBJECT_PLANE, "CRTC_X");
+	  plane.properties.crtcY = drmProperty::getId(fd, plane.id, DRM_MODE_OBJECT_PLANE, "CRTC_Y");
+	  plane.properties.crtcW = drmProperty::getId(fd, plane.id, DRM_MODE_OBJECT_PLANE, "CRTC_W");
+	  plane.properties.crtcH = drmProperty::getId(fd, plane.id, DRM_MODE_OBJECT_PLANE, "CRTC_H");
+	  plane.properties.fbDamageClips = drmProperty::findId(fd, plane.id, DRM_MODE_OBJECT_PLANE, "FB_DAMAGE_CLIPS");
+	  planes.push_back(std::move(plane));
+	}
+    }
+  catch (...)
+    {
+      drmModeFreePlaneResources(planeRes);
+      throw;
+    }
+  drmModeFreePlaneResources(planeRes);
+}
+
+PlaneAllocator::Plane *PlaneAllocator::reserve(Type type, uint32_t crtcId, int crtcIndex, uint32_t format)
+{
+  auto it(std::find_if(planes.begin(), planes.end(), [&](Plane const &plane)
+		       {
+			 return plane.type == type && !plane.crtcId &&
+			   (plane.possibleCrtcs & (1u << crtcIndex)) && plane.supportsFormat(format);
+		       }));
+
+  if (it == planes.end())
+    return nullptr;
+  it->crtcId = crtcId;
+  return &*it;
+}
+
+void PlaneAllocator::release(Plane *plane)
+{
+  if (plane)
+    plane->crtcId = 0;
+}
+
+bool PlaneAllocator::test(drmModeAtomicReq *req, uint32_t flags) const
+{
+  return !drmModeAtomicCommit(fd, req, (flags & DRM_MODE_ATOMIC_ALLOW_MODESET) | DRM_MODE_ATOMIC_TEST_ONLY, nullptr);
+}
+
+bool PlaneAllocator::Plane::supportsFormat(uint32_t format) const
+{
+  return std::find(formats.begin(), formats.end(), format) != formats.end();
+}
+
+std::vector<uint64_t> PlaneAllocator::Plane::getModifiers(uint32_t format) const
+{
+  std::vector<uint64_t> modifiers;
+
+  for (auto const &formatModifier : formatModifiers)
+    if (formatModifier.first == format && formatModifier.second != DRM_FORMAT_MOD_INVALID)
+      modifiers.push_back(formatModifier.second);
+  return modifiers;
+}
+
+void PlaneAllocator::Plane::set(drmModeAtomicReq *req, uint32_t crtcId, uint32_t fb, Rect const &src, Rect const &dst) const
+{
+  drmModeAtomicAddProperty(req, id, properties.fbId, fb);
+  drmModeAtomicAddProperty(req, id, properties.crtcId, crtcId);
+  // source coordinates are 16.16 fixed point
+  drmModeAtomicAddProperty(req, id, properties.srcX, uint64_t(src.x) << 16);
+  drmModeAtomicAddProperty(req, id, properties.srcY, uint64_t(src.y) << 16);
+  drmModeAtomicAddProperty(req, id, properties.srcW, uint64_t(src.width) << 16);
+  drmModeAtomicAddProperty(req, id, properties.srcH, uint64_t(src.height) << 16);
+  move(req, dst.x, dst.y);
+  drmModeAtomicAddProperty(req, id, properties.crtcW, dst.width);
+  drmModeAtomicAddProperty(req, id, properties.crtcH, dst.height);
+}
+
+void PlaneAllocator::Plane::move(drmModeAtomicReq *req, int32_t x, int32_t y) const
+{
+  // CRTC_X and CRTC_Y are signed, the plane may hang off the top left of the screen
+  drmModeAtomicAddProperty(req, id, properties.crtcX, uint64_t(int64_t(x)));
+  drmModeAtomicAddProperty(req, id, properties.crtcY, uint64_t(int64_t(y)));
+}
+
+void PlaneAllocator::Plane::disable(drmModeAtomicReq *req) const
+{
+  drmModeAtomicAddProperty(req, id, properties.fbId, 0);
+  drmModeAtomicAddProperty(req, id, properties.crtcId, 0);
+}
+
+void PlaneAllocator::Plane::setDamage(drmModeAtomicReq *req, uint32_t blobId) const
+{
+  if (properties.fbDamageClips)
+    drmModeAtomicAddProperty(req, id, properties.fbDamageClips, blobId);
+}
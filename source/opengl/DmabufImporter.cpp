@@ -0,0 +1,176 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "opengl/DmabufImporter.hpp"
+
+#ifndef DRM_FORMAT_MOD_INVALID
+# define DRM_FORMAT_MOD_INVALID ((1ULL << 56) - 1)
+#endif
+
+namespace
+{
+  bool hasExtension(char const *extensions, char const *name)
+  {
+    return extensions && strstr(extensions, name);
+  }
+}
+
+DmabufImporter::DmabufImporter(GlState &state)
+  : state(state),
+    eglDisplay(eglGetCurrentDisplay()),
+    hasModifiers(false),
+    eglCreateImage(nullptr),
+    eglDestroyImage(nullptr),
+    glEGLImageTargetTexture2D(nullptr),
+    importCount(0)
+{
+  char const *eglExtensions(eglQueryString(eglDisplay, EGL_EXTENSIONS));
+  char const *glExtensions(reinterpret_cast<char const *>(glGetString(GL_EXTENSIONS)));
+
+  if (!hasExtension(eglExtensions, "EGL_EXT_image_dma_buf_import") ||
+      !hasExtension(glExtensions, "GL_OES_EGL_image_external"))
+    return;
+  hasModifiers = hasExtension(eglExtensions, "EGL_EXT_image_dma_buf_import_modifiers");
+  eglCreateImage = reinterpret_cast<PFNEGLCREATEIMAGEKHRPROC>(eglGetProcAddress("eglCreateImageKHR"));
+  eglDestroyImage = reinterpret_cast<PFNEGLDESTROYIMAGEKHRPROC>(eglGetProcAddress("eglDestroyImageKHR"));
+  glEGLImageTargetTexture2D = reinterpret_cast<PFNGLEGLIMAGETARGETTEXTURE2DOESPROC>(eglGetProcAddress("glEGLImageTargetTexture2DOES"));
+}
+
+DmabufImporter::~DmabufImporter()
+{
+  for (auto &keyEntry : cache)
+    {
+      state.forgetTexture(keyEntry.second.texture);
+      eglDestroyImage(eglDisplay, keyEntry.second.image);
+      close(keyEntry.second.fd);
+    }
+}
+
+bool DmabufImporter::isSupported() const
+{
+  return eglCreateImage && eglDestroyImage && glEGLImageTargetTexture2D;
+}
+
+bool DmabufImporter::Key::operator<(Key const &other) const
+{
+  return std::tie(device, inode, format, modifier) < std::tie(other.device, other.inode, other.format, other.modifier);
+}
+
+DmabufImporter::Key DmabufImporter::getKey(Dmabuf const &dmabuf) const
+{
+  struct stat stat;
+
+  if (fstat(dmabuf.fds[0], &stat))
+    {
+      throw std::runtime_error(std::string("Cannot stat dmabuf: ") + strerror(errno));
+    }
+  return {stat.st_dev, stat.st_ino, dmabuf.format, dmabuf.modifier};
+}
+
+EGLImageKHR DmabufImporter::createImage(Dmabuf const &dmabuf) const
+{
+  static EGLint const planeAttributes[4][5] = {
+    {EGL_DMA_BUF_PLANE0_FD_EXT, EGL_DMA_BUF_PLANE0_OFFSET_EXT, EGL_DMA_BUF_PLANE0_PITCH_EXT,
+     EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT},
+    {EGL_DMA_BUF_PLANE1_FD_EXT, EGL_DMA_BUF_PLANE1_OFFSET_EXT, EGL_DMA_BUF_PLANE1_PITCH_EXT,
+     EGL_DMA_BUF_PLANE1_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE1_MODIFIER_HI_EXT},
+    {EGL_DMA_BUF_PLANE2_FD_EXT, EGL_DMA_BUF_PLANE2_OFFSET_EXT, EGL_DMA_BUF_PLANE2_PITCH_EXT,
+     EGL_DMA_BUF_PLANE2_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE2_MODIFIER_HI_EXT},
+    {EGL_DMA_BUF_PLANE3_FD_EXT, EGL_DMA_BUF_PLANE3_OFFSET_EXT, EGL_DMA_BUF_PLANE3_PITCH_EXT,
+     EGL_DMA_BUF_PLANE3_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE3_MODIFIER_HI_EXT},
+  };
+  std::vector<EGLint> attributes{
+    EGL_WIDTH, static_cast<EGLint>(dmabuf.width),
+    EGL_HEIGHT, static_cast<EGLint>(dmabuf.height),
+    EGL_LINUX_DRM_FOURCC_EXT, static_cast<EGLint>(dmabuf.format)};
+
+  if (dmabuf.modifier != DRM_FORMAT_MOD_INVALID && !hasModifiers)
+    {
+      throw std::runtime_error("dmabuf has an explicit modifier, EGL_EXT_image_dma_buf_import_modifiers missing");
+    }
+  for (unsigned int plane = 0; plane < dmabuf.planeCount && plane < 4; ++plane)
+    {
+      attributes.insert(attributes.end(), {
+	  planeAttributes[plane][0], dmabuf.fds[plane],
+	  planeAttributes[plane][1], static_cast<EGLint>(dmabuf.offsets[plane]),
+	  planeAttributes[plane][2], static_cast<EGLint>(dmabuf.strides[plane])});
+      if (dmabuf.modifier != DRM_FORMAT_MOD_INVALID)
+	attributes.insert(attributes.end(), {
+	    planeAttributes[plane][3], static_cast<EGLint>(dmabuf.modifier & 0xffffffffu),
+	    planeAttributes[plane][4], static_cast<EGLint>(dmabuf.modifier >> 32u)});
+    }
+  attributes.push_back(EGL_NONE);
+
+  EGLImageKHR image(eglCreateImage(eglDisplay, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, nullptr, attributes.data()));
+  if (image == EGL_NO_IMAGE_KHR)
+    {
+      throw std::runtime_error("Cannot import dmabuf, EGL error " + std::to_string(eglGetError()));
+    }
+  return image;
+}
+
+GLuint DmabufImporter::import(Dmabuf const &dmabuf)
+{
+  if (!isSupported())
+    {
+      throw std::runtime_error("dmabuf import not supported");
+    }
+
+  Key key(getKey(dmabuf));
+  auto it(cache.find(key));
+  if (it != cache.end())
+    return it->second.texture;
+
+  int fd(fcntl(dmabuf.fds[0], F_DUPFD_CLOEXEC, 0));
+  if (fd < 0)
+    {
+      throw std::runtime_error(std::string("Cannot dup dmabuf: ") + strerror(errno));
+    }
+
+  EGLImageKHR image;
+  try
+    {
+      image = createImage(dmabuf);
+    }
+  catch (...)
+    {
+      close(fd);
+      throw;
+    }
+
+  Texture texture;
+  state.bindTexture(0, GL_TEXTURE_EXTERNAL_OES, texture);
+  glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glEGLImageTargetTexture2D(GL_TEXTURE_EXTERNAL_OES, image);
+
+  GLuint name(texture);
+  cache.emplace(key, Entry{fd, image, std::move(texture)});
+  ++importCount;
+  return name;
+}
+
+void DmabufImporter::release(Dmabuf const &dmabuf)
+{
+  auto it(cache.find(getKey(dmabuf)));
+
+  if (it == cache.end())
+    return;
+  state.forgetTexture(it->second.texture);
+  eglDestroyImage(eglDisplay, it->second.image);
+  close(it->second.fd);
+  cache.erase(it);
+}
+
+unsigned int DmabufImporter::getImportCount() const
+{
+  return importCount;
+}
@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "opengl/GlCompositor.hpp"
+#include "opengl/my_opengl.hpp"
+#include "pixel/Bmp.hpp"
+#include "pixel/Convert.hpp"
+#include "pixel/Ktx2.hpp"
+
+namespace
+{
+  // Pixels the rectangle touches
+  pixel::Rect getOuterRect(float x, float y, float width, float height)
+  {
+    int32_t const left(static_cast<int32_t>(std::floor(x)));
+    int32_t const top(static_cast<int32_t>(std::floor(y)));
+
+    return {left, top, static_cast<int32_t>(std::ceil(x + width)) - left, static_cast<int32_t>(std::ceil(y + height)) - top};
+  }
+
+  // Pixels the rectangle covers entirely
+  pixel::Rect getInnerRect(float x, float y, float width, float height)
+  {
+    int32_t const left(static_cast<int32_t>(std::ceil(x)));
+    int32_t const top(static_cast<int32_t>(std::ceil(y)));
+
+    return {left, top, static_cast<int32_t>(std::floor(x + width)) - left, static_cast<int32_t>(std::floor(y + height)) - top};
+  }
+
+  // Part of the surface inside clip, the texture rectangle shrinks along
+  SurfaceRenderer::Surface clipSurface(SurfaceRenderer::Surface surface, pixel::Rect const &clip)
+  {
+    float const left(std::max(surface.x, static_cast<float>(clip.x)));
+    float const top(std::max(surface.y, static_cast<float>(clip.y)));
+    float const right(std::min(surface.x + surface.width, static_cast<float>(clip.x + clip.width)));
+    float const bottom(std::min(surface.y + surface.height, static_cast<float>(clip.y + clip.height)));
+    float const scaleX(surface.srcWidth / surface.width);
+    float const scaleY(surface.srcHeight / surface.height);
+
+    surface.srcX += (left - surface.x) * scaleX;
+    surface.srcY += (top - surface.y) * scaleY;
+    surface.srcWidth = (right - left) * scaleX;
+    surface.srcHeight = (bottom - top) * scaleY;
+    surface.x = left;
+    surface.y = top;
+    surface.width = right - left;
+    surface.height = bottom - top;
+    return surface;
+  }
+}
+
+GlCompositor::GlCompositor(Scene const &scene)
+  : scene(scene),
+    width(0),
+    height(0),
+    cursor{{{0, 0, 0, 0}, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, false}, {}},
+    cursorVisible(false),
+    drawCallCount(0),
+    culledCount(0)
+{
+  // a precompressed background takes a fraction of the memory and bandwidth, it's used when GL can sample it
+  try
+    {
+      pixel::Ktx2 background(pixel::loadKtx2("resource/BackgroundSpace.ktx2"));
+      GLenum format(my_opengl::getKtx2Format(background.vkFormat));
+
+      if (format && format != GL_RGBA8 && format != GL_SRGB8_ALPHA8)
+	{
+	  imageWidth = background.width;
+	  imageHeight = background.height;
+	  imageTopRowFirst = background.topRowFirst;
+	  image = renderer.createCompressedTexture(format, imageWidth, imageHeight,
+						   background.levels[0].data, background.levels[0].size);
+	  return;
+	}
+    }
+  catch (std::runtime_error const &)
+    {
+    }
+
+  // the rows are in GL order already, they are uploaded straight from the page cache and the sampler reorders the bytes
+  pixel::MappedBmp background(pixel::mapBmp("resource/BackgroundSpace.bmp"));
+
+  imageWidth = background.width;
+  imageHeight = background.height;
+  imageTopRowFirst = false;
+  image = renderer.createTexture(imageWidth, imageHeight, background.pixels, my_opengl::BMP_SWIZZLE);
+}
+
+void GlCompositor::layout(uint32_t width, uint32_t height)
+{
+  float const w(static_cast<float>(width));
+  float const h(static_cast<float>(height));
+  // BMP rows are stored bottom first, the source rectangle is flipped
+  float const srcWidth(static_cast<float>(imageWidth));
+  float const srcY(imageTopRowFirst ? 0.0f : static_cast<float>(imageHeight));
+  float const srcHeight(imageTopRowFirst ? static_cast<float>(imageHeight) : -static_cast<float>(imageHeight));
+
+  this->width = width;
+  this->height = height;
+  layers.clear();
+  layers.push_back({{image, 0.0f, 0.0f, w, h, 0.0f, srcY, srcWidth, srcHeight, 1.0f, true}, {}});
+  if (scene.maximizedWindow)
+    layers.push_back({{image, 0.0f, 0.0f, w, h, 0.0f, srcY, srcWidth, srcHeight, 1.0f, true}, {}});
+
+  // windows spread over the screen with a fixed pseudo random sequence, so runs are comparable
+  uint32_t seed(1);
+  for (unsigned int i = 0; i < scene.windowCount; ++i)
+    {
+      seed = seed * 1664525u + 1013904223u;
+      float x(static_cast<float>(seed >> 16u) / 65536.0f * w * 0.75f);
+      seed = seed * 1664525u + 1013904223u;
+      float y(static_cast<float>(seed >> 16u) / 65536.0f * h * 0.75f);
+
+      layers.push_back({{image, x, y, w / 4.0f, h / 4.0f, 0.0f, srcY, srcWidth, srcHeight, scene.opaqueWindows ? 1.0f : 0.9f, true}, {}});
+    }
+
+  // the surfaces ignore the image alpha, all of each is opaque
+  for (Layer &layer : layers)
+    layer.opaqueRegion = pixel::Region(getOuterRect(0.0f, 0.0f, layer.surface.width, layer.surface.height));
+}
+
+void GlCompositor::setCursor(uint32_t const *argb, pixel::Rect const &rect)
+{
+  cursorVisible = argb && !rect.isEmpty();
+  if (!cursorVisible)
+    return;
+
+  std::size_t const size(static_cast<std::size_t>(rect.width) * static_cast<std::size_t>(rect.height));
+  SurfaceRenderer::Surface &surface(cursor.surface);
+
+  if (surface.texture.width != static_cast<uint32_t>(rect.width) || surface.texture.height != static_cast<uint32_t>(rect.height) ||
+      !std::equal(argb, argb + size, cursorImage.begin(), cursorImage.end()))
+    {
+      // the texture wants RGBA bytes, ARGB8888 words are BGRA bytes
+      std::vector<uint32_t> rgba(size);
+
+      cursorImage.assign(argb, argb + size);
+      pixel::swizzle(rgba.data(), 0, argb, 0, static_cast<uint32_t>(size), 1, pixel::SWAP_RED_BLUE);
+      if (surface.texture.width)
+	renderer.destroyTexture(surface.texture);
+      surface.texture = renderer.createTexture(static_cast<uint32_t>(rect.width), static_cast<uint32_t>(rect.height), rgba.data());
+    }
+  surface.x = static_cast<float>(rect.x);
+  surface.y = static_cast<float>(rect.y);
+  surface.width = static_cast<float>(rect.width);
+  surface.height = static_cast<float>(rect.height);
+  surface.srcWidth = surface.width;
+  surface.srcHeight = surface.height;
+}
+
+void GlCompositor::addVisibleParts(Layer const &layer, pixel::Rect const &rect)
+{
+  SurfaceRenderer::Surface const &surface(layer.surface);
+  pixel::Rect const bounds(getOuterRect(surface.x, surface.y, surface.width, surface.height).intersect(rect));
+
+  if (bounds.isEmpty())
+    return;
+
+  pixel::Region visible(bounds);
+  for (pixel::Rect const &occluder : occluders)
+    {
+      visible.subtract(occluder);
+      if (visible.isEmpty())
+	break;
+    }
+  if (visible.isEmpty())
+    {
+      ++culledCount;
+      return;
+    }
+  if (visible.getRects().front().contains(bounds))
+    visibleSurfaces.push_back(surface);
+  else
+    for (pixel::Rect const &visibleRect : visible.getRects())
+      visibleSurfaces.push_back(clipSurface(surface, visibleRect));
+
+  if (surface.opacity < 1.0f)
+    return;
+  pixel::Rect const inner(getInnerRect(surface.x, surface.y, surface.width, surface.height));
+  for (pixel::Rect const &opaqueRect : layer.opaqueRegion.getRects())
+    {
+      pixel::Rect occluder(getInnerRect(surface.x + static_cast<float>(opaqueRect.x), surface.y + static_cast<float>(opaqueRect.y),
+					 static_cast<float>(opaqueRect.width), static_cast<float>(opaqueRect.height)));
+
+      occluder = occluder.intersect(inner).intersect(rect);
+      if (!occluder.isEmpty())
+	occluders.push_back(occluder);
+    }
+}
+
+void GlCompositor::draw(uint32_t width, uint32_t height, pixel::Region const &repaint)
+{
+  if (width != this->width || height != this->height)
+    layout(width, height);
+
+  drawCallCount = 0;
+  culledCount = 0;
+  GlState &state(renderer.getState());
+  GpuProfiler::Scope composeSpan(profiler, "compose");
+
+  state.setEnabled(GL_SCISSOR_TEST, true);
+  for (pixel::Rect const &rect : repaint.getRects())
+    {
+      GpuProfiler::Scope rectSpan(profiler, "rect");
+
+      // the scissor origin is the bottom left corner
+      state.scissor(rect.x, static_cast<GLint>(height) - rect.y - rect.height, rect.width, rect.height);
+
+      // front to back, each surface only shows where no opaque surface in front of it covers the rectangle
+      occluders.clear();
+      visibleSurfaces.clear();
+      if (cursorVisible)
+	addVisibleParts(cursor, rect);
+      for (auto layer = layers.rbegin(); layer != layers.rend(); ++layer)
+	addVisibleParts(*layer, rect);
+      std::reverse(visibleSurfaces.begin(), visibleSurfaces.end());
+      renderer.draw(visibleSurfaces, width, height);
+      drawCallCount += renderer.getDrawCallCount();
+    }
+  state.setEnabled(GL_SCISSOR_TEST, false);
+}
+
+unsigned int GlCompositor::getDrawCallCount() const
+{
+  return drawCallCount;
+}
+
+unsigned int GlCompositor::getCulledCount() const
+{
+  return culledCount;
+}
+
+GlState const &GlCompositor::getState()
+{
+  return renderer.getState();
+}
+
+GpuProfiler &GlCompositor::getProfiler()
+{
+  return profiler;
+}
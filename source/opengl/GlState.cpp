@@ -0,0 +1,121 @@
+#include "opengl/GlState.hpp"
+#include <GLES2/gl2ext.h>
+
+namespace
+{
+  // Index of a shadowed texture target, TARGET_COUNT for the others
+  std::size_t getTargetIndex(GLenum target)
+  {
+    switch (target)
+      {
+      case GL_TEXTURE_2D:
+	return 0;
+      case GL_TEXTURE_2D_ARRAY:
+	return 1;
+      case GL_TEXTURE_EXTERNAL_OES:
+	return 2;
+      default:
+	return 3;
+      }
+  }
+}
+
+void GlState::useProgram(GLuint program)
+{
+  if (update(this->program, program))
+    glUseProgram(program);
+}
+
+void GlState::bindVertexArray(GLuint vao)
+{
+  if (update(this->vao, vao))
+    glBindVertexArray(vao);
+}
+
+void GlState::bindBuffer(GLenum target, GLuint buffer)
+{
+  if (target != GL_ARRAY_BUFFER)
+    {
+      ++callCount;
+      glBindBuffer(target, buffer);
+    }
+  else if (update(arrayBuffer, buffer))
+    {
+      glBindBuffer(target, buffer);
+    }
+}
+
+void GlState::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+  if (update(activeUnit, unit))
+    glActiveTexture(GL_TEXTURE0 + unit);
+
+  std::size_t targetIndex(getTargetIndex(target));
+  if (unit >= UNIT_COUNT || targetIndex >= TARGET_COUNT)
+    {
+      ++callCount;
+      glBindTexture(target, texture);
+    }
+  else if (update(textures[unit][targetIndex], texture))
+    {
+      glBindTexture(target, texture);
+    }
+}
+
+void GlState::setEnabled(GLenum capability, bool enabled)
+{
+  std::optional<bool> *shadow(capability == GL_BLEND ? &blend : capability == GL_SCISSOR_TEST ? &scissorTest : nullptr);
+
+  if (shadow && !update(*shadow, enabled))
+    return;
+  if (!shadow)
+    ++callCount;
+  if (enabled)
+    glEnable(capability);
+  else
+    glDisable(capability);
+}
+
+void GlState::blendFunc(GLenum source, GLenum destination)
+{
+  if (update(blendFactors, std::make_tuple(source, destination)))
+    glBlendFunc(source, destination);
+}
+
+void GlState::scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+  if (update(scissorBox, std::make_tuple(x, y, width, height)))
+    glScissor(x, y, width, height);
+}
+
+void GlState::forgetTexture(GLuint texture)
+{
+  for (auto &unitTextures : textures)
+    for (std::optional<GLuint> &bound : unitTextures)
+      if (bound == texture)
+	bound.reset();
+}
+
+void GlState::invalidate()
+{
+  program.reset();
+  vao.reset();
+  arrayBuffer.reset();
+  activeUnit.reset();
+  for (auto &unitTextures : textures)
+    unitTextures.fill(std::nullopt);
+  blend.reset();
+  scissorTest.reset();
+  blendFactors.reset();
+  scissorBox.reset();
+}
+
+unsigned long GlState::getCallCount() const
+{
+  return callCount;
+}
+
+unsigned long GlState::getElidedCallCount() const
+{
+  return elidedCallCount;
+}
@@ -0,0 +1,259 @@
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+#include <EGL/egl.h>
+
+#include "opengl/GpuProfiler.hpp"
+
+namespace
+{
+  volatile std::sig_atomic_t traceRequested(0);
+
+  double toMilliseconds(std::chrono::nanoseconds time)
+  {
+    return std::chrono::duration<double, std::milli>(time).count();
+  }
+
+  // Names come from the code, only quotes and backslashes would need escaping
+  void writeJsonString(std::ostream &output, char const *string)
+  {
+    output << '"';
+    for (; *string; ++string)
+      {
+	if (*string == '"' || *string == '\\')
+	  output << '\\';
+	output << *string;
+      }
+    output << '"';
+  }
+}
+
+GpuProfiler::Scope::Scope(GpuProfiler &profiler, char const *name)
+  : profiler(profiler)
+{
+  profiler.begin(name);
+}
+
+GpuProfiler::Scope::~Scope()
+{
+  profiler.end();
+}
+
+GpuProfiler::GpuProfiler()
+  : queryCounter(nullptr),
+    getQueryObjectui64v(nullptr),
+    queries{},
+    owners{},
+    first(0),
+    used(0),
+    firstSpan(0),
+    stallCount(0)
+{
+  char const *extensions(reinterpret_cast<char const *>(glGetString(GL_EXTENSIONS)));
+  GLint timestampBits(0);
+
+  if (!extensions || !strstr(extensions, "GL_EXT_disjoint_timer_query"))
+    return;
+  // the extension allows implementations without timestamps, elapsed time queries can't nest
+  glGetQueryiv(GL_TIMESTAMP_EXT, GL_QUERY_COUNTER_BITS_EXT, &timestampBits);
+  if (glGetError() != GL_NO_ERROR || !timestampBits)
+    return;
+  queryCounter = reinterpret_cast<PFNGLQUERYCOUNTEREXTPROC>(eglGetProcAddress("glQueryCounterEXT"));
+  getQueryObjectui64v = reinterpret_cast<PFNGLGETQUERYOBJECTUI64VEXTPROC>(eglGetProcAddress("glGetQueryObjectui64vEXT"));
+  if (isSupported())
+    glGenQueries(QUERY_COUNT, queries.data());
+}
+
+GpuProfiler::~GpuProfiler()
+{
+  if (isSupported())
+    glDeleteQueries(QUERY_COUNT, queries.data());
+}
+
+bool GpuProfiler::isSupported() const
+{
+  return queryCounter && getQueryObjectui64v;
+}
+
+void GpuProfiler::begin(char const *name)
+{
+  if (!isSupported())
+    return;
+
+  std::size_t span(firstSpan + spans.size());
+
+  spans.push_back({name, static_cast<unsigned int>(openSpans.size()), 0, 0, 0, false});
+  openSpans.push_back(span);
+  issueTimestamp(span, false);
+}
+
+void GpuProfiler::end()
+{
+  if (!isSupported() || openSpans.empty())
+    return;
+
+  std::size_t span(openSpans.back());
+
+  openSpans.pop_back();
+  spans[span - firstSpan].ended = true;
+  issueTimestamp(span, true);
+}
+
+void GpuProfiler::issueTimestamp(std::size_t span, bool isEnd)
+{
+  // the ring is full, the oldest timestamp has to land before its query is reused
+  if (used == QUERY_COUNT)
+    {
+      ++stallCount;
+      readOldestQuery(true);
+    }
+
+  unsigned int query((first + used) % QUERY_COUNT);
+
+  owners[query] = {span, isEnd};
+  queryCounter(queries[query], GL_TIMESTAMP_EXT);
+  ++used;
+}
+
+bool GpuProfiler::readOldestQuery(bool wait)
+{
+  GLuint available(GL_FALSE);
+  GLuint64 timestamp(0);
+
+  if (!wait)
+    glGetQueryObjectuiv(queries[first], GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!wait && !available)
+    return false;
+  getQueryObjectui64v(queries[first], GL_QUERY_RESULT, &timestamp);
+
+  Span &span(spans[owners[first].span - firstSpan]);
+  (owners[first].isEnd ? span.end : span.begin) = timestamp;
+  ++span.readCount;
+  first = (first + 1) % QUERY_COUNT;
+  --used;
+  return true;
+}
+
+void GpuProfiler::collect(bool wait)
+{
+  if (!isSupported())
+    return;
+
+  // queries land in order, stop at the first one still in flight
+  while (used && readOldestQuery(wait))
+    ;
+
+  std::vector<Span> finished;
+  while (!spans.empty() && spans.front().readCount == 2)
+    {
+      finished.push_back(spans.front());
+      spans.pop_front();
+      ++firstSpan;
+    }
+
+  // a disjoint event (power state change, reset...) makes the timestamps meaningless
+  GLint disjoint(0);
+  glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+  if (!disjoint)
+    for (Span const &span : finished)
+      {
+	std::deque<std::chrono::nanoseconds> &nameSamples(samples[span.name]);
+
+	nameSamples.emplace_back(span.end - span.begin);
+	if (nameSamples.size() > WINDOW)
+	  nameSamples.pop_front();
+	trace.push_back(span);
+	if (trace.size() > TRACE_SPANS)
+	  trace.pop_front();
+      }
+
+  if (traceRequested)
+    {
+      char const *runtimeDirectory(std::getenv("XDG_RUNTIME_DIR"));
+      std::string path(std::string(runtimeDirectory ? runtimeDirectory : "/tmp") + "/feathers-gpu-trace-" + std::to_string(getpid()) + ".json");
+
+      traceRequested = 0;
+      if (writeTrace(path))
+	std::cerr << "GPU trace written to " << path << std::endl;
+      else
+	std::cerr << "Cannot write GPU trace to " << path << std::endl;
+    }
+}
+
+void GpuProfiler::clear()
+{
+  samples.clear();
+  trace.clear();
+}
+
+GpuProfiler::Stats GpuProfiler::getStats(std::string const &name) const
+{
+  auto it(samples.find(name));
+
+  if (it == samples.end() || it->second.empty())
+    return {0, {}, {}, {}, {}, {}};
+
+  std::vector<std::chrono::nanoseconds> sorted(it->second.begin(), it->second.end());
+  std::sort(sorted.begin(), sorted.end());
+  auto percentile([&](std::size_t percent)
+		  {
+		    return sorted[(sorted.size() - 1) * percent / 100];
+		  });
+
+  return {sorted.size(), sorted.front(), percentile(50), percentile(90), percentile(99), sorted.back()};
+}
+
+void GpuProfiler::print(std::ostream &output) const
+{
+  for (auto const &nameSamples : samples)
+    {
+      Stats stats(getStats(nameSamples.first));
+
+      output << "gpu " << nameSamples.first << " (ms, last " << stats.count << "): min " << toMilliseconds(stats.min)
+	     << ", p50 " << toMilliseconds(stats.p50)
+	     << ", p90 " << toMilliseconds(stats.p90)
+	     << ", p99 " << toMilliseconds(stats.p99)
+	     << ", max " << toMilliseconds(stats.max) << std::endl;
+    }
+}
+
+void GpuProfiler::writeTrace(std::ostream &output) const
+{
+  uint64_t origin(trace.empty() ? 0 : trace.front().begin);
+
+  // complete events in microseconds, nested spans show as a flame graph
+  output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  for (std::size_t i = 0; i < trace.size(); ++i)
+    {
+      Span const &span(trace[i]);
+
+      output << (i ? ",\n" : "\n") << "{\"name\":";
+      writeJsonString(output, span.name);
+      output << ",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":" << getpid() << ",\"tid\":\"GPU\",\"ts\":"
+	     << static_cast<double>(span.begin - origin) / 1000.0 << ",\"dur\":"
+	     << static_cast<double>(span.end - span.begin) / 1000.0 << ",\"args\":{\"depth\":" << span.depth << "}}";
+    }
+  output << "\n]}\n";
+}
+
+bool GpuProfiler::writeTrace(std::string const &path) const
+{
+  std::ofstream output(path, std::ios::trunc);
+
+  writeTrace(output);
+  return static_cast<bool>(output);
+}
+
+unsigned int GpuProfiler::getStallCount() const
+{
+  return stallCount;
+}
+
+void GpuProfiler::requestTrace()
+{
+  traceRequested = 1;
+}
@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+
+#include "opengl/SurfaceRenderer.hpp"
+#include <GLES2/gl2ext.h>
+
+SurfaceRenderer::SurfaceRenderer()
+  : program(my_opengl::createProgram("surface")),
+    viewportSizeLocation(glGetUniformLocation(program, "viewportSize")),
+    externalProgram(my_opengl::createProgram("surface", "surfaceExternal")),
+    externalViewportSizeLocation(glGetUniformLocation(externalProgram, "viewportSize")),
+    instanceBufferSize(0),
+    maxLayers(0),
+    maxTextureSize(0),
+    drawCallCount(0)
+{
+  glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+  state.useProgram(program);
+  glUniform1i(glGetUniformLocation(program, "images"), 0);
+  state.useProgram(externalProgram);
+  glUniform1i(glGetUniformLocation(externalProgram, "image"), 0);
+
+  // the quad corners come from gl_VertexID, only the instance attributes are read from a buffer
+  state.bindVertexArray(vao);
+  state.bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+  for (GLuint attribute = 0; attribute < 3; ++attribute)
+    {
+      glEnableVertexAttribArray(attribute);
+      glVertexAttribDivisor(attribute, 1);
+    }
+  setInstanceOffset(0);
+}
+
+SurfaceRenderer::TextureSlot SurfaceRenderer::createTexture(uint32_t width, uint32_t height, void const *rgba)
+{
+  if (width > static_cast<uint32_t>(maxTextureSize) || height > static_cast<uint32_t>(maxTextureSize))
+    {
+      throw std::runtime_error("Texture bigger than GL_MAX_TEXTURE_SIZE");
+    }
+
+  unsigned int array(getArray(getArraySize(width), getArraySize(height)));
+  TextureArray &textureArray(arrays[array]);
+
+  if (textureArray.freeLayers.empty())
+    grow(textureArray);
+
+  TextureSlot slot{array, textureArray.freeLayers.back(), width, height};
+
+  textureArray.freeLayers.pop_back();
+  updateTexture(slot, rgba);
+  return slot;
+}
+
+void SurfaceRenderer::updateTexture(TextureSlot const &slot, void const *rgba)
+{
+  updateTexture(slot, pixel::Rect{0, 0, static_cast<int32_t>(slot.width), static_cast<int32_t>(slot.height)},
+		rgba, slot.width * 4u);
+}
+
+void SurfaceRenderer::updateTexture(TextureSlot const &slot, pixel::Rect const &rect, void const *pixels, std::size_t stride)
+{
+  pixel::Rect const clipped(rect.intersect({0, 0, static_cast<int32_t>(slot.width), static_cast<int32_t>(slot.height)}));
+
+  if (clipped.isEmpty())
+    return;
+  TextureArray const &textureArray(arrays[slot.array]);
+  GLint const layer(static_cast<GLint>(slot.layer));
+  int32_t const right(static_cast<int32_t>(slot.width));
+  int32_t const bottom(static_cast<int32_t>(slot.height));
+  auto pixel([pixels, stride](int32_t x, int32_t y)
+	     {
+	       return static_cast<unsigned char const *>(pixels) + static_cast<std::size_t>(y) * stride + static_cast<std::size_t>(x) * 4u;
+	     });
+
+  state.bindTexture(0, GL_TEXTURE_2D_ARRAY, textureArray.texture);
+  uploader.upload(GL_TEXTURE_2D_ARRAY, layer, clipped.x, clipped.y, clipped.width, clipped.height, pixel(clipped.x, clipped.y), stride);
+
+  // linear filtering reads a texel past the image, in a padded layer the padding repeats the last column and row
+  bool const padRight(textureArray.width > slot.width && clipped.x + clipped.width == right);
+  bool const padBottom(textureArray.height > slot.height && clipped.y + clipped.height == bottom);
+
+  if (padRight)
+    uploader.upload(GL_TEXTURE_2D_ARRAY, layer, right, clipped.y, 1, clipped.height, pixel(right - 1, clipped.y), stride);
+  if (padBottom)
+    uploader.upload(GL_TEXTURE_2D_ARRAY, layer, clipped.x, bottom, clipped.width, 1, pixel(clipped.x, bottom - 1), stride);
+  if (padRight && padBottom)
+    uploader.upload(GL_TEXTURE_2D_ARRAY, layer, right, bottom, 1, 1, pixel(right - 1, bottom - 1), stride);
+}
+
+SurfaceRenderer::TextureSlot SurfaceRenderer::createTexture(uint32_t width, uint32_t height, void const *pixels,
+							     std::array<GLint, 4u> const &swizzle)
+{
+  unsigned int array(getDedicatedArray(GL_RGBA8, width, height));
+  TextureSlot slot{array, 0, width, height};
+
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_R, swizzle[0]);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_G, swizzle[1]);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_B, swizzle[2]);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_A, swizzle[3]);
+  updateTexture(slot, pixels);
+  return slot;
+}
+
+SurfaceRenderer::TextureSlot SurfaceRenderer::createCompressedTexture(GLenum format, uint32_t width, uint32_t height,
+								     void const *data, std::size_t size)
+{
+  unsigned int array(getDedicatedArray(format, width, height));
+
+  glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, static_cast<GLsizei>(width), static_cast<GLsizei>(height), 1,
+			    format, static_cast<GLsizei>(size), data);
+  return {array, 0, width, height};
+}
+
+SurfaceRenderer::TextureSlot SurfaceRenderer::addExternalTexture(GLuint texture, uint32_t width, uint32_t height)
+{
+  // the source rectangle is normalized by the entry size, like for the arrays
+  auto it(std::find_if(arrays.begin(), arrays.end(), [](TextureArray const &textureArray)
+		       {
+			 return textureArray.external && !textureArray.width;
+		       }));
+
+  if (it == arrays.end())
+    it = arrays.insert(arrays.end(), {0, 0, GL_RGBA8, 1, Texture(), {}, false, true, 0});
+  it->width = width;
+  it->height = height;
+  it->externalTexture = texture;
+  return {static_cast<unsigned int>(it - arrays.begin()), 0, width, height};
+}
+
+void SurfaceRenderer::destroyTexture(TextureSlot const &slot)
+{
+  TextureArray &textureArray(arrays[slot.array]);
+
+  if (textureArray.external)
+    {
+      textureArray.width = 0;
+      textureArray.height = 0;
+      textureArray.externalTexture = 0;
+      return;
+    }
+  if (textureArray.dedicated)
+    {
+      textureArray.width = 0;
+      textureArray.height = 0;
+      state.forgetTexture(textureArray.texture);
+      textureArray.texture = Texture();
+      return;
+    }
+  textureArray.freeLayers.push_back(slot.layer);
+}
+
+uint32_t SurfaceRenderer::getArraySize(uint32_t size) const
+{
+  // buckets start at 64 pixels so that small surfaces like cursors share an array
+  uint32_t rounded(64);
+
+  if (size > MAX_BUCKET_SIZE)
+    return size;
+  while (rounded < size)
+    rounded <<= 1u;
+  return rounded;
+}
+
+unsigned int SurfaceRenderer::getArray(uint32_t width, uint32_t height)
+{
+  // prefer an array that still has room, arrays of the same size only exist once one is full
+  auto it(std::find_if(arrays.begin(), arrays.end(), [&](TextureArray const &textureArray)
+		       {
+			 return !textureArray.external && !textureArray.dedicated && textureArray.width == width && textureArray.height == height &&
+			   (!textureArray.freeLayers.empty() || textureArray.capacity < static_cast<unsigned int>(maxLayers));
+		       }));
+
+  if (it != arrays.end())
+    return static_cast<unsigned int>(it - arrays.begin());
+  arrays.push_back({width, height, GL_RGBA8, 0, Texture(), {}, false, false, 0});
+  return static_cast<unsigned int>(arrays.size() - 1);
+}
+
+unsigned int SurfaceRenderer::getDedicatedArray(GLenum format, uint32_t width, uint32_t height)
+{
+  if (width > static_cast<uint32_t>(maxTextureSize) || height > static_cast<uint32_t>(maxTextureSize))
+    {
+      throw std::runtime_error("Texture bigger than GL_MAX_TEXTURE_SIZE");
+    }
+
+  // immutable storage with a single layer, the image size is kept as is
+  auto it(std::find_if(arrays.begin(), arrays.end(), [](TextureArray const &textureArray)
+		       {
+			 return textureArray.dedicated && !textureArray.width;
+		       }));
+
+  if (it == arrays.end())
+    it = arrays.insert(arrays.end(), {0, 0, format, 1, Texture(), {}, true, false, 0});
+  it->width = width;
+  it->height = height;
+  it->format = format;
+  state.forgetTexture(it->texture);
+  it->texture = Texture();
+
+  state.bindTexture(0, GL_TEXTURE_2D_ARRAY, it->texture);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, format, static_cast<GLsizei>(width), static_cast<GLsizei>(height), 1);
+  return static_cast<unsigned int>(it - arrays.begin());
+}
+
+void SurfaceRenderer::grow(TextureArray &textureArray)
+{
+  unsigned int capacity(std::min(std::max(textureArray.capacity * 2, INITIAL_LAYERS), static_cast<unsigned int>(maxLayers)));
+  Texture texture;
+
+  if (capacity <= textureArray.capacity)
+    {
+      throw std::runtime_error("Texture array is full");
+    }
+  state.bindTexture(0, GL_TEXTURE_2D_ARRAY, texture);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8,
+		 static_cast<GLsizei>(textureArray.width), static_cast<GLsizei>(textureArray.height),
+		 static_cast<GLsizei>(capacity));
+
+  // immutable storage can't be resized, the existing layers are copied on the GPU
+  if (textureArray.capacity)
+    {
+      GLint readFramebuffer(0);
+
+      glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, copyFramebuffer);
+      for (unsigned int layer = 0; layer < textureArray.capacity; ++layer)
+	{
+	  glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textureArray.texture, 0, static_cast<GLint>(layer));
+	  glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, static_cast<GLint>(layer), 0, 0,
+			      static_cast<GLsizei>(textureArray.width), static_cast<GLsizei>(textureArray.height));
+	}
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<GLuint>(readFramebuffer));
+    }
+
+  for (unsigned int layer = capacity; layer > textureArray.capacity; --layer)
+    textureArray.freeLayers.push_back(layer - 1);
+  textureArray.capacity = capacity;
+  state.forgetTexture(textureArray.texture);
+  textureArray.texture = std::move(texture);
+}
+
+void SurfaceRenderer::setInstanceOffset(std::size_t first)
+{
+  std::size_t offset(first * sizeof(Instance));
+
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), reinterpret_cast<void *>(offset + offsetof(Instance, dst)));
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), reinterpret_cast<void *>(offset + offsetof(Instance, src)));
+  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), reinterpret_cast<void *>(offset + offsetof(Instance, layer)));
+}
+
+void SurfaceRenderer::draw(std::vector<Surface> const &surfaces, uint32_t viewportWidth, uint32_t viewportHeight)
+{
+  drawCallCount = 0;
+  if (surfaces.empty())
+    return;
+
+  instances.clear();
+  for (Surface const &surface : surfaces)
+    {
+      TextureArray const &textureArray(arrays[surface.texture.array]);
+      float arrayWidth(static_cast<float>(textureArray.width));
+      float arrayHeight(static_cast<float>(textureArray.height));
+
+      instances.push_back({{surface.x, surface.y, surface.width, surface.height},
+			   {surface.srcX / arrayWidth, surface.srcY / arrayHeight,
+			    surface.srcWidth / arrayWidth, surface.srcHeight / arrayHeight},
+			   static_cast<float>(surface.texture.layer),
+			   surface.opacity,
+			   surface.opaque ? 1.0f : 0.0f});
+    }
+
+  // the whole frame goes in one upload, the buffer is orphaned so the driver doesn't wait for the previous frame
+  std::size_t size(instances.size() * sizeof(Instance));
+  state.bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+  if (size > instanceBufferSize)
+    instanceBufferSize = std::max(size, instanceBufferSize * 2);
+  glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(instanceBufferSize), nullptr, GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(size), instances.data());
+
+  state.useProgram(program);
+  glUniform2f(viewportSizeLocation, static_cast<float>(viewportWidth), static_cast<float>(viewportHeight));
+  state.bindVertexArray(vao);
+  state.setEnabled(GL_BLEND, true);
+  state.blendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+  // one call per run of surfaces sharing a texture array, the z order is kept
+  for (std::size_t first = 0; first < surfaces.size();)
+    {
+      unsigned int array(surfaces[first].texture.array);
+      std::size_t last(first + 1);
+
+      while (last < surfaces.size() && surfaces[last].texture.array == array)
+	++last;
+      if (arrays[array].external)
+	{
+	  state.useProgram(externalProgram);
+	  glUniform2f(externalViewportSizeLocation, static_cast<float>(viewportWidth), static_cast<float>(viewportHeight));
+	  state.bindTexture(0, GL_TEXTURE_EXTERNAL_OES, arrays[array].externalTexture);
+	}
+      else
+	{
+	  state.useProgram(program);
+	  state.bindTexture(0, GL_TEXTURE_2D_ARRAY, arrays[array].texture);
+	}
+      // GLES 3.0 has no base instance, the attributes are pointed at the run instead
+      setInstanceOffset(first);
+      glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(last - first));
+      ++drawCallCount;
+      first = last;
+    }
+}
+
+unsigned int SurfaceRenderer::getDrawCallCount() const
+{
+  return drawCallCount;
+}
+
+GlState &SurfaceRenderer::getState()
+{
+  return state;
+}
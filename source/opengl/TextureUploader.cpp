@@ -0,0 +1,146 @@
+#include <cstring>
+#include <EGL/egl.h>
+
+#include "opengl/TextureUploader.hpp"
+#include "pixel/Convert.hpp"
+
+namespace
+{
+  // keeps every upload start aligned for the copy and the driver
+  constexpr std::size_t ALIGNMENT = 64;
+
+  void texSubImage(GLenum target, GLint layer, GLint x, GLint y, GLsizei width, GLsizei height, void const *pixels)
+  {
+    if (target == GL_TEXTURE_2D_ARRAY)
+      glTexSubImage3D(target, 0, x, y, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    else
+      glTexSubImage2D(target, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  }
+
+  // The driver reads the rows straight from the client memory, no pixel unpack buffer may be bound
+  void texSubImageFromClient(GLenum target, GLint layer, GLint x, GLint y, GLsizei width, GLsizei height, void const *pixels, std::size_t stride)
+  {
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, static_cast<GLint>(stride / 4u));
+    texSubImage(target, layer, x, y, width, height, pixels);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  }
+}
+
+TextureUploader::TextureUploader(std::size_t capacity)
+  : capacity(capacity),
+    mapping(nullptr),
+    head(0),
+    stallCount(0)
+{
+  char const *extensions(reinterpret_cast<char const *>(glGetString(GL_EXTENSIONS)));
+  PFNGLBUFFERSTORAGEEXTPROC bufferStorage(nullptr);
+
+  if (extensions && strstr(extensions, "GL_EXT_buffer_storage"))
+    bufferStorage = reinterpret_cast<PFNGLBUFFERSTORAGEEXTPROC>(eglGetProcAddress("glBufferStorageEXT"));
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+  if (bufferStorage)
+    {
+      GLbitfield const flags(GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT_EXT | GL_MAP_COHERENT_BIT_EXT);
+
+      bufferStorage(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(capacity), nullptr, flags);
+      mapping = static_cast<unsigned char *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(capacity), flags));
+    }
+  if (!mapping)
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(capacity), nullptr, GL_STREAM_DRAW);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+TextureUploader::~TextureUploader()
+{
+  for (Pending const &upload : pending)
+    glDeleteSync(upload.fence);
+  if (mapping)
+    {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+}
+
+void TextureUploader::upload(GLenum target, GLint layer, GLint x, GLint y, GLsizei width, GLsizei height,
+			     void const *pixels, std::size_t stride)
+{
+  std::size_t const rowSize(static_cast<std::size_t>(width) * 4u);
+  std::size_t const size(rowSize * static_cast<std::size_t>(height));
+
+  if (!size)
+    return;
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  // too big to ever fit
+  if (size > capacity)
+    {
+      texSubImageFromClient(target, layer, x, y, width, height, pixels, stride);
+      return;
+    }
+
+  std::size_t const offset(allocate(size));
+  unsigned char *dst(mapping ? mapping + offset : nullptr);
+  unsigned char const *src(static_cast<unsigned char const *>(pixels));
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+  // the range is fenced, the driver must not wait for the GPU before handing it out
+  if (!mapping)
+    dst = static_cast<unsigned char *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size),
+							 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+  // out of address space or a driver error, the range is just left unused
+  if (!dst)
+    {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      texSubImageFromClient(target, layer, x, y, width, height, pixels, stride);
+      return;
+    }
+  // rows are packed in the ring, the source stride doesn't waste ring space
+  pixel::copyRows(dst, rowSize, src, stride, rowSize, static_cast<uint32_t>(height));
+  if (!mapping)
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+  texSubImage(target, layer, x, y, width, height, reinterpret_cast<void const *>(offset));
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  pending.push_back({offset, offset + size, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+}
+
+bool TextureUploader::isPersistent() const
+{
+  return mapping != nullptr;
+}
+
+unsigned int TextureUploader::getStallCount() const
+{
+  return stallCount;
+}
+
+std::size_t TextureUploader::allocate(std::size_t size)
+{
+  std::size_t begin((head + ALIGNMENT - 1) & ~(ALIGNMENT - 1));
+
+  // the end of the ring is too short, start over and give up what's after head
+  if (begin + size > capacity)
+    {
+      while (!pending.empty() && pending.front().begin >= head)
+	retire();
+      begin = 0;
+    }
+  while (!pending.empty() && pending.front().begin < begin + size && pending.front().end > begin)
+    retire();
+  head = begin + size;
+  return begin;
+}
+
+void TextureUploader::retire()
+{
+  GLsync fence(pending.front().fence);
+
+  if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+    {
+      ++stallCount;
+      glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    }
+  glDeleteSync(fence);
+  pending.pop_front();
+}
@@ -1,10 +1,14 @@
 #include <stdexcept>
 #include <fstream>
 #include <memory>
-#include <iostream>
-#include <sstream>
+#include <algorithm>
 #include <cstring>
+#include <vector>
+#include <stdio.h>
+#include "CacheFile.hpp"
+#include "EmbeddedShaders.hpp"
 #include "opengl/my_opengl.hpp"
+#include <GLES2/gl2ext.h>
 
 void my_opengl::shaderError(GLenum const shadertype, GLuint const shader)
 {
@@ -48,53 +52,144 @@ Shader my_opengl::createShader(GLenum const shadertype, GLchar const *src)
   return (shader);
 }
 
+namespace
+{
+  // Written at the start of each cached program binary
+  struct ProgramBinaryHeader
+  {
+    char magic[4];
+    uint32_t format;
+    uint32_t length;
+  };
+
+  constexpr char PROGRAM_BINARY_MAGIC[4] = {'F', 'P', 'B', '1'};
+
+  // FNV-1a
+  uint64_t hash(std::string const &data, uint64_t hash = 0xcbf29ce484222325ull)
+  {
+    for (unsigned char c : data)
+      hash = (hash ^ c) * 0x100000001b3ull;
+    return hash;
+  }
+
+  // Empty when there's nowhere to cache or the driver can't save programs
+  std::string getCachePath(uint64_t key)
+  {
+    GLint formatCount(0);
+
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    if (!formatCount)
+      return {};
+
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return cache::getPath(std::string(name) + ".program");
+  }
+
+  // False when the file is missing, truncated, corrupt or rejected by the driver (e.g. after an update)
+  bool loadProgramBinary(Program const &program, std::string const &path)
+  {
+    try
+      {
+	std::ifstream input(path, std::ios::binary);
+	ProgramBinaryHeader header;
+
+	if (!input.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+	    memcmp(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic)))
+	  return false;
+
+	std::vector<char> binary;
+	if (!cache::read(input, header.length, binary))
+	  return false;
+
+	GLint status(GL_FALSE);
+	glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	return status == GL_TRUE;
+      }
+    catch (std::exception const &)
+      {
+	// the program is linked from its sources instead
+	return false;
+      }
+  }
+
+  void storeProgramBinary(Program const &program, std::string const &path)
+  {
+    GLint length(0);
+    GLenum format(0);
+
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+      return;
+
+    std::vector<char> binary(static_cast<std::size_t>(length));
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    ProgramBinaryHeader header{{}, format, static_cast<uint32_t>(length)};
+    memcpy(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic));
+
+    cache::write(path, {{reinterpret_cast<char const *>(&header), sizeof(header)}, {binary.data(), binary.size()}});
+  }
+}
+
 Program my_opengl::createProgram(std::string const& name)
 {
-  std::stringstream vert;
-  std::stringstream frag;
-  std::ifstream vertInput("shaders/" + name + ".vert");
-  std::ifstream fragInput("shaders/" + name + ".frag");
+  return createProgram(name, name);
+}
 
-  if (!fragInput || !vertInput)
-    {
-      std::cout << "shaders/" + name + ".vert" << std::endl;
-      std::cout << "shaders/" + name + ".frag" << std::endl;
-      throw std::runtime_error(strerror(errno));
-    }
+Program my_opengl::createProgram(std::string const &vertexName, std::string const &fragmentName)
+{
+  std::string const vert(shaders::get(vertexName + ".vert"));
+  std::string const frag(shaders::get(fragmentName + ".frag"));
+
+  // a binary only loads back on the same sources, GPU and driver
+  uint64_t key(hash(vert + '\0' + frag));
+  for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+    key = hash(reinterpret_cast<char const *>(glGetString(name)), key);
+  std::string const path(getCachePath(key));
+  Program program;
 
-  vert << vertInput.rdbuf();
-  frag << fragInput.rdbuf();
+  if (!path.empty() && loadProgramBinary(program, path))
+    return program;
 
-  Shader vertex = my_opengl::createShader(GL_VERTEX_SHADER, vert.str().c_str());
-  Shader fragment = my_opengl::createShader(GL_FRAGMENT_SHADER, frag.str().c_str());
+  Shader vertex = my_opengl::createShader(GL_VERTEX_SHADER, vert.c_str());
+  Shader fragment = my_opengl::createShader(GL_FRAGMENT_SHADER, frag.c_str());
+  GLint status;
 
-  return my_opengl::createProgram<2>({vertex, fragment});
+  glAttachShader(program, vertex);
+  glAttachShader(program, fragment);
+  glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  glLinkProgram(program);
+  glDetachShader(program, vertex);
+  glDetachShader(program, fragment);
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (status == GL_FALSE)
+    programError(program);
+  if (!path.empty())
+    storeProgramBinary(program, path);
+  return program;
 }
 
 Shader::Shader(GLuint shadertype)
-  : shader(glCreateShader(shadertype)), count(new unsigned int(1u))
+  : shader(glCreateShader(shadertype))
 {
 }
 
 Shader::~Shader()
 {
-  if (!--*count)
-    {
-      glDeleteShader(shader);
-      delete count;
-    }
+  glDeleteShader(shader);
 }
 
-Shader::Shader(Shader const &s)
-  : shader(s.shader), count(s.count)
+Shader::Shader(Shader &&other) noexcept
+  : shader(other.shader)
 {
-  ++*count;
+  other.shader = 0;
 }
 
-Shader &Shader::operator=(Shader s)
+Shader &Shader::operator=(Shader &&other) noexcept
 {
-  std::swap(s.count, count);
-  std::swap(s.shader, shader);
+  std::swap(shader, other.shader);
   return *this;
 }
 
@@ -104,29 +199,24 @@ Shader::operator GLuint() const
 }
 
 Program::Program()
-  : program(glCreateProgram()), count(new unsigned int(1u))
+  : program(glCreateProgram())
 {
 }
 
 Program::~Program()
 {
-  if (!--*count)
-    {
-      glDeleteProgram(program);
-      delete count;
-    }
+  glDeleteProgram(program);
 }
 
-Program::Program(Program const &s)
-  : program(s.program), count(s.count)
+Program::Program(Program &&other) noexcept
+  : program(other.program)
 {
-  ++*count;
+  other.program = 0;
 }
 
-Program &Program::operator=(Program s)
+Program &Program::operator=(Program &&other) noexcept
 {
-  std::swap(s.count, count);
-  std::swap(s.program, program);
+  std::swap(program, other.program);
   return *this;
 }
 
@@ -136,30 +226,25 @@ Program::operator GLuint() const
 }
 
 Vao::Vao()
-  : vao(0u), count(new unsigned int(1u))
+  : vao(0)
 {
   glGenVertexArrays(1, &vao);
 }
 
 Vao::~Vao()
 {
-  if (!--*count)
-    {
-      glDeleteVertexArrays(1, &vao);
-      delete count;
-    }
+  glDeleteVertexArrays(1, &vao);
 }
 
-Vao::Vao(Vao const &s)
-  : vao(s.vao), count(s.count)
+Vao::Vao(Vao &&other) noexcept
+  : vao(other.vao)
 {
-  ++*count;
+  other.vao = 0;
 }
 
-Vao &Vao::operator=(Vao s)
+Vao &Vao::operator=(Vao &&other) noexcept
 {
-  std::swap(s.count, count);
-  std::swap(s.vao, vao);
+  std::swap(vao, other.vao);
   return *this;
 }
 
@@ -169,30 +254,25 @@ Vao::operator GLuint() const
 }
 
 glBuffer::glBuffer()
-  : buffer(0u), count(new unsigned int(1u))
+  : buffer(0)
 {
   glGenBuffers(1, &buffer);
 }
 
 glBuffer::~glBuffer()
 {
-  if (!--*count)
-    {
-      glDeleteBuffers(1, &buffer);
-      delete count;
-    }
+  glDeleteBuffers(1, &buffer);
 }
 
-glBuffer::glBuffer(glBuffer const &s)
-  : buffer(s.buffer), count(s.count)
+glBuffer::glBuffer(glBuffer &&other) noexcept
+  : buffer(other.buffer)
 {
-  ++*count;
+  other.buffer = 0;
 }
 
-glBuffer &glBuffer::operator=(glBuffer s)
+glBuffer &glBuffer::operator=(glBuffer &&other) noexcept
 {
-  std::swap(s.count, count);
-  std::swap(s.buffer, buffer);
+  std::swap(buffer, other.buffer);
   return *this;
 }
 
@@ -202,30 +282,25 @@ glBuffer::operator GLuint() const
 }
 
 Framebuffer::Framebuffer()
-  : framebuffer(0u), count(new unsigned int(1u))
+  : framebuffer(0)
 {
   glGenFramebuffers(1, &framebuffer);
 }
 
 Framebuffer::~Framebuffer()
 {
-  if (!--*count)
-    {
-      glDeleteFramebuffers(1, &framebuffer);
-      delete count;
-    }
+  glDeleteFramebuffers(1, &framebuffer);
 }
 
-Framebuffer::Framebuffer(Framebuffer const &s)
-  : framebuffer(s.framebuffer), count(s.count)
+Framebuffer::Framebuffer(Framebuffer &&other) noexcept
+  : framebuffer(other.framebuffer)
 {
-  ++*count;
+  other.framebuffer = 0;
 }
 
-Framebuffer &Framebuffer::operator=(Framebuffer s)
+Framebuffer &Framebuffer::operator=(Framebuffer &&other) noexcept
 {
-  std::swap(s.count, count);
-  std::swap(s.framebuffer, framebuffer);
+  std::swap(framebuffer, other.framebuffer);
   return *this;
 }
 
@@ -235,30 +310,25 @@ Framebuffer::operator GLuint() const
 }
 
 Texture::Texture()
-  : texture(0u), count(new unsigned int(1u))
+  : texture(0)
 {
   glGenTextures(1, &texture);
 }
 
 Texture::~Texture()
 {
-  if (!--*count)
-    {
-      glDeleteTextures(1, &texture);
-      delete count;
-    }
+  glDeleteTextures(1, &texture);
 }
 
-Texture::Texture(Texture const &s)
-  : texture(s.texture), count(s.count)
+Texture::Texture(Texture &&other) noexcept
+  : texture(other.texture)
 {
-  ++*count;
+  other.texture = 0;
 }
 
-Texture &Texture::operator=(Texture s)
+Texture &Texture::operator=(Texture &&other) noexcept
 {
-  std::swap(s.count, count);
-  std::swap(s.texture, texture);
+  std::swap(texture, other.texture);
   return *this;
 }
 
@@ -267,78 +337,39 @@ Texture::operator GLuint() const
   return texture;
 }
 
-Texture my_opengl::loadTexture(std::string const &name)
+GLenum my_opengl::getKtx2Format(uint32_t vkFormat)
 {
-  auto bytesToInt = [](char *bytes)
+  // VK_FORMAT_R8G8B8A8_UNORM/SRGB and the ETC2 blocks are core in GLES 3
+  switch (vkFormat)
     {
-      return (static_cast<unsigned char>(bytes[3]) << 24u)
-      | (static_cast<unsigned char>(bytes[2]) << 16u)
-      | (static_cast<unsigned char>(bytes[1]) << 8u)
-      | static_cast<unsigned char>(bytes[0]);
-    };
-  std::ifstream file(name, std::ios::binary);
-
-  if (!file)
-    throw std::runtime_error("'" + name + "': failed to open");
-  file.exceptions(std::ios::badbit);
-
-  char readBuf[4];
-  std::array<unsigned int, 2u> dim{0u, 0u};
-  try {
-    file.seekg(10);
-    file.read(readBuf, sizeof(readBuf));
-    unsigned int offset(bytesToInt(readBuf));
-
-    file.seekg(14);
-    file.read(readBuf, sizeof(readBuf));
-
-    file.read(readBuf, sizeof(readBuf));
-    dim[0] = bytesToInt(readBuf);
-
-    file.read(readBuf, sizeof(readBuf));
-    dim[1] = bytesToInt(readBuf);
-
-    file.seekg(offset);
-
-    std::unique_ptr<char[]> data(new char[dim[0] * dim[1] * sizeof(unsigned int)]);
-
-    file.read(&data[0], std::streamsize(dim[0] * dim[1] * sizeof(unsigned int)));
-
-    std::streamsize r(file.gcount());
-
-    if (r != std::streamsize(dim[0] * dim[1] * sizeof(unsigned int)))
-      {
-	std::stringstream s;
+    case 37:
+      return GL_RGBA8;
+    case 43:
+      return GL_SRGB8_ALPHA8;
+    case 147:
+      return GL_COMPRESSED_RGB8_ETC2;
+    case 148:
+      return GL_COMPRESSED_SRGB8_ETC2;
+    case 149:
+      return GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+    case 150:
+      return GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+    case 151:
+      return GL_COMPRESSED_RGBA8_ETC2_EAC;
+    case 152:
+      return GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC;
+    default:
+      break;
+    }
 
-	s << name << ": file seems truncated, " << r << std::string(" bytes read. Expected ") << std::streamsize(dim[0] * dim[1] * sizeof(unsigned int));
-	throw std::runtime_error(s.str());
-      }
-    file.exceptions(std::ios::goodbit);
+  // VK_FORMAT_ASTC_4x4_UNORM_BLOCK to VK_FORMAT_ASTC_12x12_SRGB_BLOCK alternate UNORM and SRGB,
+  // both GL ranges list the 14 block sizes in the same order
+  char const *extensions(reinterpret_cast<char const *>(glGetString(GL_EXTENSIONS)));
+  if (vkFormat >= 157 && vkFormat <= 184 && extensions && strstr(extensions, "GL_KHR_texture_compression_astc_ldr"))
+    {
+      GLenum blockSize((vkFormat - 157) / 2);
 
-    for (auto it = &data[0]; it < &data[dim[0] * dim[1] * sizeof(unsigned int)]; it += sizeof(unsigned int))
-      {
-        std::swap(it[0], it[3]);
-        std::swap(it[1], it[2]);
-      }
-    Texture texture;
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D,
-                 0,
-                 GL_RGBA,
-                 static_cast<GLsizei>(dim[0]),
-                 static_cast<GLsizei>(dim[1]),
-                 0,
-                 GL_RGBA,
-                 GL_UNSIGNED_BYTE,
-                 static_cast<void *>(data.get()));
-    glBindTexture(GL_TEXTURE_2D, 0);
-    return texture;
-  } catch (std::exception const &e) {
-    throw std::runtime_error(name + ": failed to load texture(" + std::string(e.what()) + ")");
-  }
+      return ((vkFormat - 157) % 2 ? GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR : GL_COMPRESSED_RGBA_ASTC_4x4_KHR) + blockSize;
+    }
+  return 0;
 }
@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+#endif
+
+#include "pixel/Blit.hpp"
+#include "pixel/Cpu.hpp"
+
+namespace pixel
+{
+  namespace
+  {
+    struct Kernels
+    {
+      void (*copyRow)(uint32_t *dst, uint32_t const *src, std::size_t count);
+      void (*fillRow)(uint32_t *dst, uint32_t color, std::size_t count);
+      void (*blendRow)(uint32_t *dst, uint32_t const *src, std::size_t count);
+      // non temporal stores have to be fenced before the buffer is handed to the display
+      bool needsFence;
+    };
+
+    // dst * (255 - alpha) / 255, rounded exactly like the SIMD versions
+    inline uint32_t scaleChannel(uint32_t dst, uint32_t inverseAlpha)
+    {
+      uint32_t value = dst * inverseAlpha + 128;
+
+      return (value + (value >> 8)) >> 8;
+    }
+
+    void copyRowScalar(uint32_t *dst, uint32_t const *src, std::size_t count)
+    {
+      std::memcpy(dst, src, count * sizeof(uint32_t));
+    }
+
+    void fillRowScalar(uint32_t *dst, uint32_t color, std::size_t count)
+    {
+      std::fill(dst, dst + count, color);
+    }
+
+    void blendRowScalar(uint32_t *dst, uint32_t const *src, std::size_t count)
+    {
+      for (std::size_t i = 0; i < count; ++i)
+	{
+	  uint32_t inverseAlpha = 255 - (src[i] >> 24);
+	  uint32_t result = 0;
+
+	  for (uint32_t shift = 0; shift < 32; shift += 8)
+	    {
+	      uint32_t channel = ((src[i] >> shift) & 0xff) + scaleChannel((dst[i] >> shift) & 0xff, inverseAlpha);
+
+	      result |= std::min(channel, 255u) << shift;
+	    }
+	  dst[i] = result;
+	}
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    // the destination usually is a write combined scanout buffer, so full lines are written with streaming stores
+    __attribute__((target("sse2")))
+    void copyRowSse2(uint32_t *dst, uint32_t const *src, std::size_t count)
+    {
+      std::size_t i = 0;
+
+      for (; i < count && (reinterpret_cast<uintptr_t>(dst + i) & 15); ++i)
+	dst[i] = src[i];
+      for (; i + 4 <= count; i += 4)
+	_mm_stream_si128(reinterpret_cast<__m128i *>(dst + i), _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i)));
+      for (; i < count; ++i)
+	dst[i] = src[i];
+    }
+
+    __attribute__((target("sse2")))
+    void fillRowSse2(uint32_t *dst, uint32_t color, std::size_t count)
+    {
+      __m128i value = _mm_set1_epi32(static_cast<int>(color));
+      std::size_t i = 0;
+
+      for (; i < count && (reinterpret_cast<uintptr_t>(dst + i) & 15); ++i)
+	dst[i] = color;
+      for (; i + 4 <= count; i += 4)
+	_mm_stream_si128(reinterpret_cast<__m128i *>(dst + i), value);
+      for (; i < count; ++i)
+	dst[i] = color;
+    }
+
+    // src + dst * (255 - srcAlpha) / 255 on 16 bit lanes
+    __attribute__((target("sse2")))
+    inline __m128i blendHalfSse2(__m128i src, __m128i dst)
+    {
+      __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+      __m128i value = _mm_add_epi16(_mm_mullo_epi16(dst, _mm_sub_epi16(_mm_set1_epi16(255), alpha)), _mm_set1_epi16(128));
+
+      value = _mm_srli_epi16(_mm_add_epi16(value, _mm_srli_epi16(value, 8)), 8);
+      return _mm_add_epi16(src, value);
+    }
+
+    __attribute__((target("sse2")))
+    void blendRowSse2(uint32_t *dst, uint32_t const *src, std::size_t count)
+    {
+      __m128i const zero = _mm_setzero_si128();
+      std::size_t i = 0;
+
+      for (; i + 4 <= count; i += 4)
+	{
+	  __m128i s = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i));
+	  __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i const *>(dst + i));
+	  __m128i low = blendHalfSse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+	  __m128i high = blendHalfSse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+
+	  _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(low, high));
+	}
+      blendRowScalar(dst + i, src + i, count - i);
+    }
+
+    __attribute__((target("avx2")))
+    void copyRowAvx2(uint32_t *dst, uint32_t const *src, std::size_t count)
+    {
+      std::size_t i = 0;
+
+      for (; i < count && (reinterpret_cast<uintptr_t>(dst + i) & 31); ++i)
+	dst[i] = src[i];
+      for (; i + 8 <= count; i += 8)
+	_mm256_stream_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i)));
+      for (; i < count; ++i)
+	dst[i] = src[i];
+    }
+
+    __attribute__((target("avx2")))
+    void fillRowAvx2(uint32_t *dst, uint32_t color, std::size_t count)
+    {
+      __m256i value = _mm256_set1_epi32(static_cast<int>(color));
+      std::size_t i = 0;
+
+      for (; i < count && (reinterpret_cast<uintptr_t>(dst + i) & 31); ++i)
+	dst[i] = color;
+      for (; i + 8 <= count; i += 8)
+	_mm256_stream_si256(reinterpret_cast<__m256i *>(dst + i), value);
+      for (; i < count; ++i)
+	dst[i] = color;
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i blendHalfAvx2(__m256i src, __m256i dst)
+    {
+      __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+      __m256i value = _mm256_add_epi16(_mm256_mullo_epi16(dst, _mm256_sub_epi16(_mm256_set1_epi16(255), alpha)), _mm256_set1_epi16(128));
+
+      value = _mm256_srli_epi16(_mm256_add_epi16(value, _mm256_srli_epi16(value, 8)), 8);
+      return _mm256_add_epi16(src, value);
+    }
+
+    __attribute__((target("avx2")))
+    void blendRowAvx2(uint32_t *dst, uint32_t const *src, std::size_t count)
+    {
+      __m256i const zero = _mm256_setzero_si256();
+      std::size_t i = 0;
+
+      // unpack and pack work per 128 bit lane, so the pixel order is preserved
+      for (; i + 8 <= count; i += 8)
+	{
+	  __m256i s = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i));
+	  __m256i d = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(dst + i));
+	  __m256i low = blendHalfAvx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+	  __m256i high = blendHalfAvx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+
+	  _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_packus_epi16(low, high));
+	}
+      blendRowSse2(dst + i, src + i, count - i);
+    }
+#endif
+
+    Kernels const &getKernels()
+    {
+      static Kernels const kernels([]()
+				   {
+#if defined(__x86_64__) || defined(__i386__)
+				     CpuFeatures const &features(getCpuFeatures());
+
+				     if (features.avx2)
+				       return Kernels{&copyRowAvx2, &fillRowAvx2, &blendRowAvx2, true};
+				     if (features.sse2)
+				       return Kernels{&copyRowSse2, &fillRowSse2, &blendRowSse2, true};
+#endif
+				     return Kernels{&copyRowScalar, &fillRowScalar, &blendRowScalar, false};
+				   }());
+
+      return kernels;
+    }
+
+    void fence(Kernels const &kernels)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      if (kernels.needsFence)
+	_mm_sfence();
+#else
+      static_cast<void>(kernels);
+#endif
+    }
+
+    template<class Pointer>
+    Pointer *advance(Pointer *pointer, std::size_t stride, uint32_t rows)
+    {
+      using Byte = std::conditional_t<std::is_const_v<Pointer>, unsigned char const, unsigned char>;
+
+      return reinterpret_cast<Pointer *>(reinterpret_cast<Byte *>(pointer) + stride * rows);
+    }
+  }
+
+  void copy(void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, uint32_t width, uint32_t height)
+  {
+    Kernels const &kernels(getKernels());
+
+    for (uint32_t y = 0; y < height; ++y)
+      kernels.copyRow(advance(static_cast<uint32_t *>(dst), dstStride, y), advance(static_cast<uint32_t const *>(src), srcStride, y), width);
+    fence(kernels);
+  }
+
+  void fill(void *dst, std::size_t dstStride, uint32_t color, uint32_t width, uint32_t height)
+  {
+    Kernels const &kernels(getKernels());
+
+    for (uint32_t y = 0; y < height; ++y)
+      kernels.fillRow(advance(static_cast<uint32_t *>(dst), dstStride, y), color, width);
+    fence(kernels);
+  }
+
+  void blend(void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, uint32_t width, uint32_t height)
+  {
+    Kernels const &kernels(getKernels());
+
+    for (uint32_t y = 0; y < height; ++y)
+      kernels.blendRow(advance(static_cast<uint32_t *>(dst), dstStride, y), advance(static_cast<uint32_t const *>(src), srcStride, y), width);
+  }
+}
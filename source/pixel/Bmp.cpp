@@ -0,0 +1,44 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "pixel/Bmp.hpp"
+
+namespace pixel
+{
+  MappedBmp mapBmp(std::string const &name)
+  {
+    MappedFile file(name);
+    uint8_t const *data(file.getData());
+    auto read32([&](std::size_t offset)
+		{
+		  return static_cast<uint32_t>(data[offset + 3] << 24u)
+		  | static_cast<uint32_t>(data[offset + 2] << 16u)
+		  | static_cast<uint32_t>(data[offset + 1] << 8u)
+		  | data[offset];
+		});
+
+    // file header, then the width and height of the info header
+    if (file.getSize() < 26 || data[0] != 'B' || data[1] != 'M')
+      throw std::runtime_error("'" + name + "': not a BMP file");
+
+    uint32_t offset(read32(10));
+    uint32_t width(read32(18));
+    uint32_t height(read32(22));
+    uint64_t size(uint64_t(width) * height * sizeof(uint32_t));
+
+    if (offset > file.getSize() || size > file.getSize() - offset)
+      throw std::runtime_error("'" + name + "': file seems truncated, " + std::to_string(file.getSize() - std::min<std::size_t>(offset, file.getSize()))
+			       + " bytes of pixels. Expected " + std::to_string(size));
+    return {std::move(file), width, height, data + offset};
+  }
+
+  Image loadBmp(std::string const &name)
+  {
+    MappedBmp bmp(mapBmp(name));
+    Image image{bmp.width, bmp.height, std::vector<uint32_t>(std::size_t(bmp.width) * bmp.height)};
+
+    memcpy(image.pixels.data(), bmp.pixels, image.pixels.size() * sizeof(uint32_t));
+    return image;
+  }
+}
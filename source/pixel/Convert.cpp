@@ -0,0 +1,380 @@
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+#endif
+
+#include "pixel/Convert.hpp"
+#include "pixel/Cpu.hpp"
+
+namespace pixel
+{
+  namespace
+  {
+    struct Kernels
+    {
+      void (*swizzleRow)(uint8_t *dst, uint8_t const *src, std::size_t count, Swizzle const &order);
+      void (*expandRgb888Row)(uint8_t *dst, uint8_t const *src, std::size_t count, Swizzle const &order);
+      void (*expandRgb565Row)(uint8_t *dst, uint8_t const *src, std::size_t count);
+      void (*premultiplyRow)(uint8_t *dst, uint8_t const *src, std::size_t count);
+    };
+
+    // channel * alpha / 255, rounded like scaleChannel in Blit.cpp
+    inline uint8_t multiply(uint32_t channel, uint32_t alpha)
+    {
+      uint32_t value = channel * alpha + 128;
+
+      return static_cast<uint8_t>((value + (value >> 8)) >> 8);
+    }
+
+    // the source is read before the destination is written, so both may be the same pixel
+    void swizzleRowScalar(uint8_t *dst, uint8_t const *src, std::size_t count, Swizzle const &order)
+    {
+      for (std::size_t i = 0; i < count; ++i, src += 4, dst += 4)
+	{
+	  uint8_t pixel[4];
+
+	  for (unsigned int byte = 0; byte < 4; ++byte)
+	    pixel[byte] = order[byte] == OPAQUE ? 0xff : src[order[byte]];
+	  memcpy(dst, pixel, sizeof(pixel));
+	}
+    }
+
+    void expandRgb888RowScalar(uint8_t *dst, uint8_t const *src, std::size_t count, Swizzle const &order)
+    {
+      for (std::size_t i = 0; i < count; ++i, src += 3, dst += 4)
+	for (unsigned int byte = 0; byte < 4; ++byte)
+	  dst[byte] = order[byte] == OPAQUE ? 0xff : src[order[byte]];
+    }
+
+    inline uint32_t expandRgb565(uint16_t pixel)
+    {
+      uint32_t red = (pixel >> 11u) & 0x1fu;
+      uint32_t green = (pixel >> 5u) & 0x3fu;
+      uint32_t blue = pixel & 0x1fu;
+
+      return 0xff000000u | ((red << 3u | red >> 2u) << 16u) | ((green << 2u | green >> 4u) << 8u) | (blue << 3u | blue >> 2u);
+    }
+
+    void expandRgb565RowScalar(uint8_t *dst, uint8_t const *src, std::size_t count)
+    {
+      for (std::size_t i = 0; i < count; ++i)
+	{
+	  uint16_t pixel;
+	  uint32_t expanded;
+
+	  memcpy(&pixel, src + i * 2, sizeof(pixel));
+	  expanded = expandRgb565(pixel);
+	  memcpy(dst + i * 4, &expanded, sizeof(expanded));
+	}
+    }
+
+    void premultiplyRowScalar(uint8_t *dst, uint8_t const *src, std::size_t count)
+    {
+      for (std::size_t i = 0; i < count; ++i, src += 4, dst += 4)
+	{
+	  uint8_t alpha = src[3];
+
+	  dst[0] = multiply(src[0], alpha);
+	  dst[1] = multiply(src[1], alpha);
+	  dst[2] = multiply(src[2], alpha);
+	  dst[3] = alpha;
+	}
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    // pshufb indices of 4 pixels packed in 16 bytes, spaced by srcSize bytes, OPAQUE bytes read 0 (index bit 7)
+    std::array<uint8_t, 16> getShuffleMask(Swizzle const &order, unsigned int srcSize)
+    {
+      std::array<uint8_t, 16> mask;
+
+      for (unsigned int pixel = 0; pixel < 4; ++pixel)
+	for (unsigned int byte = 0; byte < 4; ++byte)
+	  mask[pixel * 4 + byte] = order[byte] == OPAQUE ? 0x80 : static_cast<uint8_t>(pixel * srcSize + order[byte]);
+      return mask;
+    }
+
+    // 0xff on the OPAQUE bytes
+    uint32_t getOpaqueBits(Swizzle const &order)
+    {
+      uint32_t bits = 0;
+
+      for (unsigned int byte = 0; byte < 4; ++byte)
+	if (order[byte] == OPAQUE)
+	  bits |= 0xffu << (byte * 8);
+      return bits;
+    }
+
+    // without a byte shuffle, each destination byte is shifted in place from its source byte
+    __attribute__((target("sse2")))
+    void swizzleRowSse2(uint8_t *dst, uint8_t const *src, std::size_t count, Swizzle const &order)
+    {
+      __m128i const byteMask = _mm_set1_epi32(0xff);
+      __m128i const opaque = _mm_set1_epi32(static_cast<int>(getOpaqueBits(order)));
+      std::size_t i = 0;
+
+      for (; i + 4 <= count; i += 4)
+	{
+	  __m128i pixels = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * 4));
+	  __m128i result = opaque;
+
+	  for (unsigned int byte = 0; byte < 4; ++byte)
+	    if (order[byte] != OPAQUE)
+	      {
+		__m128i channel = _mm_and_si128(_mm_srl_epi32(pixels, _mm_cvtsi32_si128(order[byte] * 8)), byteMask);
+
+		result = _mm_or_si128(result, _mm_sll_epi32(channel, _mm_cvtsi32_si128(static_cast<int>(byte * 8))));
+	      }
+	  _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), result);
+	}
+      swizzleRowScalar(dst + i * 4, src + i * 4, count - i, order);
+    }
+
+    __attribute__((target("ssse3")))
+    void swizzleRowSsse3(uint8_t *dst, uint8_t const *src, std::size_t count, Swizzle const &order)
+    {
+      std::array<uint8_t, 16> const maskBytes(getShuffleMask(order, 4));
+      __m128i const mask = _mm_loadu_si128(reinterpret_cast<__m128i const *>(maskBytes.data()));
+      __m128i const opaque = _mm_set1_epi32(static_cast<int>(getOpaqueBits(order)));
+      std::size_t i = 0;
+
+      for (; i + 4 <= count; i += 4)
+	{
+	  __m128i pixels = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * 4));
+
+	  _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(pixels, mask), opaque));
+	}
+      swizzleRowScalar(dst + i * 4, src + i * 4, count - i, order);
+    }
+
+    // 4 pixels take 12 of the 16 bytes loaded, the loop stops before reading past the row
+    __attribute__((target("ssse3")))
+    void expandRgb888RowSsse3(uint8_t *dst, uint8_t const *src, std::size_t count, Swizzle const &order)
+    {
+      std::array<uint8_t, 16> const maskBytes(getShuffleMask(order, 3));
+      __m128i const mask = _mm_loadu_si128(reinterpret_cast<__m128i const *>(maskBytes.data()));
+      __m128i const opaque = _mm_set1_epi32(static_cast<int>(getOpaqueBits(order)));
+      std::size_t i = 0;
+
+      for (; i + 6 <= count; i += 4)
+	{
+	  __m128i pixels = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * 3));
+
+	  _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(pixels, mask), opaque));
+	}
+      expandRgb888RowScalar(dst + i * 4, src + i * 3, count - i, order);
+    }
+
+    // 8 pixels as 16 bit lanes, red and green are moved to their place then the channel is replicated
+    __attribute__((target("sse2")))
+    void expandRgb565RowSse2(uint8_t *dst, uint8_t const *src, std::size_t count)
+    {
+      __m128i const alpha = _mm_set1_epi16(static_cast<short>(0xff00));
+      std::size_t i = 0;
+
+      for (; i + 8 <= count; i += 8)
+	{
+	  __m128i pixels = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * 2));
+	  __m128i red = _mm_srli_epi16(pixels, 11);
+	  __m128i green = _mm_and_si128(_mm_srli_epi16(pixels, 5), _mm_set1_epi16(0x3f));
+	  __m128i blue = _mm_and_si128(pixels, _mm_set1_epi16(0x1f));
+
+	  red = _mm_or_si128(_mm_slli_epi16(red, 3), _mm_srli_epi16(red, 2));
+	  green = _mm_or_si128(_mm_slli_epi16(green, 2), _mm_srli_epi16(green, 4));
+	  blue = _mm_or_si128(_mm_slli_epi16(blue, 3), _mm_srli_epi16(blue, 2));
+
+	  // B, G bytes then R, A bytes, interleaved into B, G, R, A
+	  __m128i low = _mm_or_si128(blue, _mm_slli_epi16(green, 8));
+	  __m128i high = _mm_or_si128(red, alpha);
+
+	  _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), _mm_unpacklo_epi16(low, high));
+	  _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4 + 16), _mm_unpackhi_epi16(low, high));
+	}
+      expandRgb565RowScalar(dst + i * 4, src + i * 2, count - i);
+    }
+
+    // channels * alpha on 16 bit lanes, alpha itself is kept
+    __attribute__((target("sse2")))
+    inline __m128i premultiplyHalfSse2(__m128i pixels)
+    {
+      __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+      __m128i value = _mm_add_epi16(_mm_mullo_epi16(pixels, alpha), _mm_set1_epi16(128));
+
+      value = _mm_srli_epi16(_mm_add_epi16(value, _mm_srli_epi16(value, 8)), 8);
+      return value;
+    }
+
+    __attribute__((target("sse2")))
+    void premultiplyRowSse2(uint8_t *dst, uint8_t const *src, std::size_t count)
+    {
+      __m128i const zero = _mm_setzero_si128();
+      __m128i const alphaMask = _mm_set1_epi32(static_cast<int>(0xff000000u));
+      std::size_t i = 0;
+
+      for (; i + 4 <= count; i += 4)
+	{
+	  __m128i pixels = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * 4));
+	  __m128i low = premultiplyHalfSse2(_mm_unpacklo_epi8(pixels, zero));
+	  __m128i high = premultiplyHalfSse2(_mm_unpackhi_epi8(pixels, zero));
+	  __m128i result = _mm_packus_epi16(low, high);
+
+	  result = _mm_or_si128(_mm_andnot_si128(alphaMask, result), _mm_and_si128(alphaMask, pixels));
+	  _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), result);
+	}
+      premultiplyRowScalar(dst + i * 4, src + i * 4, count - i);
+    }
+
+    __attribute__((target("avx2")))
+    void swizzleRowAvx2(uint8_t *dst, uint8_t const *src, std::size_t count, Swizzle const &order)
+    {
+      std::array<uint8_t, 16> const maskBytes(getShuffleMask(order, 4));
+      // pshufb works within each 128 bit lane, both use the same mask
+      __m256i const mask = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const *>(maskBytes.data())));
+      __m256i const opaque = _mm256_set1_epi32(static_cast<int>(getOpaqueBits(order)));
+      std::size_t i = 0;
+
+      for (; i + 8 <= count; i += 8)
+	{
+	  __m256i pixels = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i * 4));
+
+	  _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(pixels, mask), opaque));
+	}
+      swizzleRowSsse3(dst + i * 4, src + i * 4, count - i, order);
+    }
+
+    // each lane gets 4 pixels, loaded 12 bytes apart
+    __attribute__((target("avx2")))
+    void expandRgb888RowAvx2(uint8_t *dst, uint8_t const *src, std::size_t count, Swizzle const &order)
+    {
+      std::array<uint8_t, 16> const maskBytes(getShuffleMask(order, 3));
+      __m256i const mask = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const *>(maskBytes.data())));
+      __m256i const opaque = _mm256_set1_epi32(static_cast<int>(getOpaqueBits(order)));
+      std::size_t i = 0;
+
+      for (; i + 10 <= count; i += 8)
+	{
+	  __m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * 3))),
+						   _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * 3 + 12)), 1);
+
+	  _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(pixels, mask), opaque));
+	}
+      expandRgb888RowSsse3(dst + i * 4, src + i * 3, count - i, order);
+    }
+
+    // 8 pixels widened to 32 bit lanes, so no interleaving is needed
+    __attribute__((target("avx2")))
+    void expandRgb565RowAvx2(uint8_t *dst, uint8_t const *src, std::size_t count)
+    {
+      std::size_t i = 0;
+
+      for (; i + 8 <= count; i += 8)
+	{
+	  __m256i pixels = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i * 2)));
+	  __m256i red = _mm256_srli_epi32(pixels, 11);
+	  __m256i green = _mm256_and_si256(_mm256_srli_epi32(pixels, 5), _mm256_set1_epi32(0x3f));
+	  __m256i blue = _mm256_and_si256(pixels, _mm256_set1_epi32(0x1f));
+
+	  red = _mm256_or_si256(_mm256_slli_epi32(red, 3), _mm256_srli_epi32(red, 2));
+	  green = _mm256_or_si256(_mm256_slli_epi32(green, 2), _mm256_srli_epi32(green, 4));
+	  blue = _mm256_or_si256(_mm256_slli_epi32(blue, 3), _mm256_srli_epi32(blue, 2));
+
+	  __m256i result = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(red, 16), _mm256_slli_epi32(green, 8)),
+					   _mm256_or_si256(blue, _mm256_set1_epi32(static_cast<int>(0xff000000u))));
+
+	  _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), result);
+	}
+      expandRgb565RowSse2(dst + i * 4, src + i * 2, count - i);
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i premultiplyHalfAvx2(__m256i pixels)
+    {
+      __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+      __m256i value = _mm256_add_epi16(_mm256_mullo_epi16(pixels, alpha), _mm256_set1_epi16(128));
+
+      return _mm256_srli_epi16(_mm256_add_epi16(value, _mm256_srli_epi16(value, 8)), 8);
+    }
+
+    __attribute__((target("avx2")))
+    void premultiplyRowAvx2(uint8_t *dst, uint8_t const *src, std::size_t count)
+    {
+      __m256i const zero = _mm256_setzero_si256();
+      __m256i const alphaMask = _mm256_set1_epi32(static_cast<int>(0xff000000u));
+      std::size_t i = 0;
+
+      // unpack and pack work per 128 bit lane, so the pixel order is preserved
+      for (; i + 8 <= count; i += 8)
+	{
+	  __m256i pixels = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i * 4));
+	  __m256i low = premultiplyHalfAvx2(_mm256_unpacklo_epi8(pixels, zero));
+	  __m256i high = premultiplyHalfAvx2(_mm256_unpackhi_epi8(pixels, zero));
+	  __m256i result = _mm256_packus_epi16(low, high);
+
+	  result = _mm256_or_si256(_mm256_andnot_si256(alphaMask, result), _mm256_and_si256(alphaMask, pixels));
+	  _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), result);
+	}
+      premultiplyRowSse2(dst + i * 4, src + i * 4, count - i);
+    }
+#endif
+
+    Kernels const &getKernels()
+    {
+      static Kernels const kernels([]()
+				   {
+#if defined(__x86_64__) || defined(__i386__)
+				     CpuFeatures const &features(getCpuFeatures());
+
+				     if (features.avx2)
+				       return Kernels{&swizzleRowAvx2, &expandRgb888RowAvx2, &expandRgb565RowAvx2, &premultiplyRowAvx2};
+				     if (features.ssse3)
+				       return Kernels{&swizzleRowSsse3, &expandRgb888RowSsse3, &expandRgb565RowSse2, &premultiplyRowSse2};
+				     if (features.sse2)
+				       return Kernels{&swizzleRowSse2, &expandRgb888RowScalar, &expandRgb565RowSse2, &premultiplyRowSse2};
+#endif
+				     return Kernels{&swizzleRowScalar, &expandRgb888RowScalar, &expandRgb565RowScalar, &premultiplyRowScalar};
+				   }());
+
+      return kernels;
+    }
+
+    template<class Row, class... Args>
+    void convert(Row row, void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, uint32_t width, uint32_t height,
+		 Args const &... args)
+    {
+      for (uint32_t y = 0; y < height; ++y)
+	row(static_cast<uint8_t *>(dst) + dstStride * y, static_cast<uint8_t const *>(src) + srcStride * y, width, args...);
+    }
+  }
+
+  void swizzle(void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, uint32_t width, uint32_t height,
+	       Swizzle const &order)
+  {
+    convert(getKernels().swizzleRow, dst, dstStride, src, srcStride, width, height, order);
+  }
+
+  void expandRgb888(void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, uint32_t width, uint32_t height,
+		    Swizzle const &order)
+  {
+    convert(getKernels().expandRgb888Row, dst, dstStride, src, srcStride, width, height, order);
+  }
+
+  void expandRgb565(void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, uint32_t width, uint32_t height)
+  {
+    convert(getKernels().expandRgb565Row, dst, dstStride, src, srcStride, width, height);
+  }
+
+  void premultiply(void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, uint32_t width, uint32_t height)
+  {
+    convert(getKernels().premultiplyRow, dst, dstStride, src, srcStride, width, height);
+  }
+
+  void copyRows(void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, std::size_t rowSize, uint32_t height)
+  {
+    if (dstStride == rowSize && srcStride == rowSize)
+      {
+	memcpy(dst, src, rowSize * height);
+	return;
+      }
+    for (uint32_t y = 0; y < height; ++y)
+      memcpy(static_cast<uint8_t *>(dst) + dstStride * y, static_cast<uint8_t const *>(src) + srcStride * y, rowSize);
+  }
+}
@@ -0,0 +1,33 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "pixel/Cpu.hpp"
+
+namespace pixel
+{
+  CpuFeatures const &getCpuFeatures()
+  {
+    static CpuFeatures const features([]()
+				      {
+					CpuFeatures detected{false, false, false};
+#if defined(__x86_64__) || defined(__i386__)
+					__builtin_cpu_init();
+					detected.sse2 = __builtin_cpu_supports("sse2");
+					detected.ssse3 = __builtin_cpu_supports("ssse3");
+					detected.avx2 = __builtin_cpu_supports("avx2");
+#endif
+					if (char const *limit = std::getenv("FEATHERS_SIMD"))
+					  {
+					    if (!strcmp(limit, "scalar"))
+					      detected = CpuFeatures{false, false, false};
+					    else if (!strcmp(limit, "sse2"))
+					      detected.ssse3 = detected.avx2 = false;
+					    else if (!strcmp(limit, "ssse3"))
+					      detected.avx2 = false;
+					  }
+					return detected;
+				      }());
+
+    return features;
+  }
+}
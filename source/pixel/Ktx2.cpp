@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "pixel/Ktx2.hpp"
+
+namespace pixel
+{
+  namespace
+  {
+    constexpr uint8_t IDENTIFIER[12] = {0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'};
+    // identifier, 9 header fields then the index up to the level index
+    constexpr std::size_t HEADER_SIZE = 12 + 9 * 4 + 4 * 4 + 2 * 8;
+    constexpr std::size_t LEVEL_SIZE = 3 * 8;
+
+    template<class T>
+    T read(uint8_t const *data, std::size_t offset)
+    {
+      T value;
+
+      memcpy(&value, data + offset, sizeof(value));
+      return value;
+    }
+  }
+
+  Ktx2 loadKtx2(std::string const &name)
+  {
+    MappedFile file(name);
+    uint8_t const *data(file.getData());
+    std::size_t const size(file.getSize());
+    auto error([&](char const *what)
+	       {
+		 return std::runtime_error("'" + name + "': " + what);
+	       });
+
+    if (size < HEADER_SIZE || memcmp(data, IDENTIFIER, sizeof(IDENTIFIER)))
+      throw error("not a KTX2 file");
+
+    uint32_t vkFormat(read<uint32_t>(data, 12));
+    uint32_t width(read<uint32_t>(data, 20));
+    uint32_t height(read<uint32_t>(data, 24));
+    uint32_t depth(read<uint32_t>(data, 28));
+    uint32_t layerCount(read<uint32_t>(data, 32));
+    uint32_t faceCount(read<uint32_t>(data, 36));
+    uint32_t levelCount(read<uint32_t>(data, 40));
+    uint32_t supercompression(read<uint32_t>(data, 44));
+    uint32_t kvdOffset(read<uint32_t>(data, 56));
+    uint32_t kvdLength(read<uint32_t>(data, 60));
+
+    if (!width || !height || depth > 1 || layerCount > 1 || faceCount != 1)
+      throw error("only single 2D textures are supported");
+    if (supercompression)
+      throw error("supercompressed textures are not supported");
+    // 0 levels asks the loader to generate them, there's still the base one in the file
+    levelCount = std::max(levelCount, 1u);
+    if (HEADER_SIZE + levelCount * LEVEL_SIZE > size || kvdOffset > size || kvdLength > size - kvdOffset)
+      throw error("file seems truncated");
+
+    Ktx2 ktx2{std::move(file), vkFormat, width, height, {}, true};
+    for (uint32_t level = 0; level < levelCount; ++level)
+      {
+	uint64_t offset(read<uint64_t>(data, HEADER_SIZE + level * LEVEL_SIZE));
+	std::size_t length(read<uint64_t>(data, HEADER_SIZE + level * LEVEL_SIZE + 8));
+
+	if (offset > size || length > size - offset)
+	  throw error("file seems truncated");
+	ktx2.levels.push_back({data + offset, length});
+      }
+
+    // key/value pairs: 4 byte length, "key\0value", padded to 4 bytes
+    for (std::size_t offset = kvdOffset; offset + 4 <= kvdOffset + kvdLength;)
+      {
+	uint32_t length(read<uint32_t>(data, offset));
+	char const *pair(reinterpret_cast<char const *>(data + offset + 4));
+
+	if (length > kvdOffset + kvdLength - offset - 4)
+	  break;
+	// "rd" is right then down, "ru" right then up
+	if (length >= 17 && !memcmp(pair, "KTXorientation", 15) && pair[16] == 'u')
+	  ktx2.topRowFirst = false;
+	offset += 4 + ((length + 3u) & ~3u);
+      }
+    return ktx2;
+  }
+}
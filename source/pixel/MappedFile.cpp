@@ -0,0 +1,79 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include "pixel/MappedFile.hpp"
+
+namespace pixel
+{
+  MappedFile::MappedFile(std::string const &name)
+    : data(nullptr),
+      size(0)
+  {
+    int fd(open(name.c_str(), O_RDONLY | O_CLOEXEC));
+    struct stat status;
+
+    if (fd < 0)
+      throw std::runtime_error("'" + name + "': failed to open: " + strerror(errno));
+    if (fstat(fd, &status) < 0)
+      {
+	int error(errno);
+
+	close(fd);
+	throw std::runtime_error("'" + name + "': failed to stat: " + strerror(error));
+      }
+    size = static_cast<std::size_t>(status.st_size);
+    // mapping 0 bytes fails, an empty file just has no data
+    if (size)
+      {
+	data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+	  {
+	    int error(errno);
+
+	    data = nullptr;
+	    close(fd);
+	    throw std::runtime_error("'" + name + "': failed to map: " + strerror(error));
+	  }
+	// the whole file is about to be read, start paging it in
+	madvise(data, size, MADV_WILLNEED);
+      }
+    close(fd);
+  }
+
+  MappedFile::MappedFile(MappedFile &&other) noexcept
+    : data(other.data),
+      size(other.size)
+  {
+    other.data = nullptr;
+    other.size = 0;
+  }
+
+  MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+  {
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+    return *this;
+  }
+
+  MappedFile::~MappedFile()
+  {
+    if (data)
+      munmap(data, size);
+  }
+
+  uint8_t const *MappedFile::getData() const
+  {
+    return static_cast<uint8_t const *>(data);
+  }
+
+  std::size_t MappedFile::getSize() const
+  {
+    return size;
+  }
+}
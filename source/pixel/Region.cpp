@@ -0,0 +1,147 @@
+#include <algorithm>
+
+#include "pixel/Region.hpp"
+
+namespace pixel
+{
+  namespace
+  {
+    // Appends the parts of rect outside cut, at most 4 bands
+    void subtract(Rect const &rect, Rect const &cut, std::vector<Rect> &out)
+    {
+      Rect inter(rect.intersect(cut));
+
+      if (inter.isEmpty())
+	{
+	  out.push_back(rect);
+	  return;
+	}
+      if (inter.y > rect.y)
+	out.push_back({rect.x, rect.y, rect.width, inter.y - rect.y});
+      if (inter.y + inter.height < rect.y + rect.height)
+	out.push_back({rect.x, inter.y + inter.height, rect.width, rect.y + rect.height - inter.y - inter.height});
+      if (inter.x > rect.x)
+	out.push_back({rect.x, inter.y, inter.x - rect.x, inter.height});
+      if (inter.x + inter.width < rect.x + rect.width)
+	out.push_back({inter.x + inter.width, inter.y, rect.x + rect.width - inter.x - inter.width, inter.height});
+    }
+  }
+
+  bool Rect::isEmpty() const
+  {
+    return width <= 0 || height <= 0;
+  }
+
+  bool Rect::contains(Rect const &other) const
+  {
+    return other.x >= x && other.y >= y &&
+      other.x + other.width <= x + width && other.y + other.height <= y + height;
+  }
+
+  Rect Rect::intersect(Rect const &other) const
+  {
+    int32_t left(std::max(x, other.x));
+    int32_t top(std::max(y, other.y));
+    int32_t right(std::min(x + width, other.x + other.width));
+    int32_t bottom(std::min(y + height, other.y + other.height));
+
+    if (right <= left || bottom <= top)
+      return {0, 0, 0, 0};
+    return {left, top, right - left, bottom - top};
+  }
+
+  Region::Region(Rect const &rect)
+  {
+    add(rect);
+  }
+
+  void Region::add(Rect const &rect)
+  {
+    if (rect.isEmpty() || std::any_of(rects.begin(), rects.end(), [&](Rect const &r) { return r.contains(rect); }))
+      return;
+    rects.erase(std::remove_if(rects.begin(), rects.end(), [&](Rect const &r) { return rect.contains(r); }), rects.end());
+
+    // only the parts not covered yet are added, so the rectangles never overlap
+    std::vector<Rect> pieces{rect};
+    std::vector<Rect> remaining;
+    for (Rect const &existing : rects)
+      {
+	remaining.clear();
+	for (Rect const &piece : pieces)
+	  pixel::subtract(piece, existing, remaining);
+	pieces.swap(remaining);
+      }
+    rects.insert(rects.end(), pieces.begin(), pieces.end());
+
+    if (rects.size() > MAX_RECTS)
+      {
+	Rect extents(getExtents());
+
+	rects.assign(1, extents);
+      }
+  }
+
+  void Region::add(Region const &region)
+  {
+    for (Rect const &rect : region.rects)
+      add(rect);
+  }
+
+  void Region::intersect(Rect const &clip)
+  {
+    for (Rect &rect : rects)
+      rect = rect.intersect(clip);
+    rects.erase(std::remove_if(rects.begin(), rects.end(), [](Rect const &r) { return r.isEmpty(); }), rects.end());
+  }
+
+  void Region::subtract(Rect const &cut)
+  {
+    std::vector<Rect> remaining;
+
+    for (Rect const &rect : rects)
+      pixel::subtract(rect, cut, remaining);
+    rects.swap(remaining);
+
+    if (rects.size() > MAX_RECTS)
+      {
+	Rect extents(getExtents());
+
+	rects.assign(1, extents);
+      }
+  }
+
+  void Region::clear()
+  {
+    rects.clear();
+  }
+
+  bool Region::isEmpty() const
+  {
+    return rects.empty();
+  }
+
+  Rect Region::getExtents() const
+  {
+    if (rects.empty())
+      return {0, 0, 0, 0};
+
+    int32_t left(rects.front().x);
+    int32_t top(rects.front().y);
+    int32_t right(left + rects.front().width);
+    int32_t bottom(top + rects.front().height);
+
+    for (Rect const &rect : rects)
+      {
+	left = std::min(left, rect.x);
+	top = std::min(top, rect.y);
+	right = std::max(right, rect.x + rect.width);
+	bottom = std::max(bottom, rect.y + rect.height);
+      }
+    return {left, top, right - left, bottom - top};
+  }
+
+  std::vector<Rect> const &Region::getRects() const
+  {
+    return rects;
+  }
+}
@@ -0,0 +1,68 @@
+#include <algorithm>
+
+#include "software/SoftwareCompositor.hpp"
+#include "modeset/Output.hpp"
+#include "modeset/DumbSurface.hpp"
+#include "pixel/Bmp.hpp"
+#include "pixel/Blit.hpp"
+#include "pixel/Convert.hpp"
+
+SoftwareCompositor::SoftwareCompositor()
+{
+  pixel::Image bmp(pixel::loadBmp("resource/BackgroundSpace.bmp"));
+
+  // BMP pixels are stored as RGBA from the bottom row, scanout wants XRGB from the top row
+  imageWidth = bmp.width;
+  imageHeight = bmp.height;
+  image.resize(bmp.pixels.size());
+  for (uint32_t y = 0; y < imageHeight; ++y)
+    pixel::swizzle(&image[y * imageWidth], 0, &bmp.pixels[(imageHeight - 1 - y) * imageWidth], 0, imageWidth, 1, {1, 2, 3, pixel::OPAQUE});
+}
+
+SoftwareCompositor::Background const &SoftwareCompositor::getBackground(int width, int height)
+{
+  for (Background const &background : backgrounds)
+    if (background.width == width && background.height == height)
+      return background;
+
+  // nearest neighbour scaling, done once per output size
+  Background background{width, height, std::vector<uint32_t>(static_cast<std::size_t>(width) * height)};
+  for (int y = 0; y < height; ++y)
+    {
+      uint32_t const *src(&image[uint64_t(y) * imageHeight / height * imageWidth]);
+      uint32_t *dst(&background.pixels[static_cast<std::size_t>(y) * width]);
+
+      for (int x = 0; x < width; ++x)
+	dst[x] = src[uint64_t(x) * imageWidth / width];
+    }
+  backgrounds.push_back(std::move(background));
+  return backgrounds.back();
+}
+
+void SoftwareCompositor::draw(Output &output, pixel::Region const &repaint)
+{
+  DumbBuffer &buffer(static_cast<DumbSurface &>(output.getSurface()).getBackBuffer());
+  Background const &background(getBackground(output.getWidth(), output.getHeight()));
+  char *pixels(static_cast<char *>(buffer.getPixels()));
+  PlaneAllocator::Rect cursorRect(output.getCursorRect());
+  pixel::Rect cursor{cursorRect.x, cursorRect.y, static_cast<int32_t>(cursorRect.width), static_cast<int32_t>(cursorRect.height)};
+  bool drawCursor(output.isCursorVisible() && !output.isCursorOnPlane());
+
+  for (pixel::Rect const &rect : repaint.getRects())
+    {
+      pixel::copy(pixels + static_cast<std::size_t>(rect.y) * buffer.getStride() + rect.x * sizeof(uint32_t), buffer.getStride(),
+		  &background.pixels[static_cast<std::size_t>(rect.y) * background.width + rect.x], background.width * sizeof(uint32_t),
+		  static_cast<uint32_t>(rect.width), static_cast<uint32_t>(rect.height));
+
+      // the cursor is only drawn here when no plane could take it
+      pixel::Rect area(cursor.intersect(rect));
+      if (drawCursor && !area.isEmpty())
+	{
+	  uint32_t const *src(&output.getCursorImage()[static_cast<std::size_t>(area.y - cursor.y) * cursorRect.width + (area.x - cursor.x)]);
+
+	  pixel::blend(pixels + static_cast<std::size_t>(area.y) * buffer.getStride() + area.x * sizeof(uint32_t), buffer.getStride(),
+		       src, cursorRect.width * sizeof(uint32_t),
+		       static_cast<uint32_t>(area.width), static_cast<uint32_t>(area.height));
+	}
+    }
+}
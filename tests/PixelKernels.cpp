@@ -0,0 +1,316 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "pixel/Blit.hpp"
+#include "pixel/Convert.hpp"
+#include "pixel/Cpu.hpp"
+
+/*
+ * Checks the pixel kernels picked for this cpu, capped by FEATHERS_SIMD, against a scalar reference.
+ * Every width up to a few SIMD blocks, every alignment of the buffers and packed or padded strides are tried,
+ * and nothing may be written outside of the rows.
+ */
+namespace
+{
+  constexpr uint32_t MAX_WIDTH = 80;
+  constexpr uint32_t HEIGHT = 3;
+  constexpr unsigned int MAX_OFFSET = 32;
+  constexpr uint8_t GUARD = 0xa5;
+
+  unsigned int failures = 0;
+
+  // c * a / 255 rounded to nearest
+  uint8_t multiply(uint32_t channel, uint32_t alpha)
+  {
+    return static_cast<uint8_t>((channel * alpha + 127) / 255);
+  }
+
+  // size bits widened to 8 by repeating their high bits
+  uint8_t replicateBits(uint32_t bits, uint32_t size)
+  {
+    return static_cast<uint8_t>(bits << (8 - size) | bits >> (2 * size - 8));
+  }
+
+  void fail(std::string const &what, uint32_t width, unsigned int offset, std::size_t padding)
+  {
+    if (++failures <= 20)
+      std::cerr << what << " differs from the reference, width " << width << " offset " << offset << " padding " << padding << std::endl;
+  }
+
+  // deterministic noise, so a failure can be reproduced
+  void randomize(std::vector<uint8_t> &bytes, uint32_t seed)
+  {
+    for (uint8_t &byte : bytes)
+      {
+	seed = seed * 1664525u + 1013904223u;
+	byte = static_cast<uint8_t>(seed >> 24);
+      }
+  }
+
+  // Rows starting offset bytes past a 32 byte boundary, between GUARD bytes
+  struct Image
+  {
+    std::vector<uint8_t> storage;
+    uint8_t *data;
+    std::size_t stride;
+
+    Image(std::size_t rowSize, std::size_t padding, unsigned int offset)
+      : storage(MAX_OFFSET * 4 + (rowSize + padding) * HEIGHT, GUARD)
+      , stride(rowSize + padding)
+    {
+      data = storage.data() + MAX_OFFSET * 2 - reinterpret_cast<uintptr_t>(storage.data()) % MAX_OFFSET + offset;
+    }
+
+    Image(Image const &) = delete;
+
+    // the rows and the guards around them, which don't depend on where the storage is
+    uint8_t *begin() const
+    {
+      return data - MAX_OFFSET;
+    }
+
+    uint8_t *end() const
+    {
+      return data + stride * HEIGHT + MAX_OFFSET;
+    }
+
+    void copy(Image const &other)
+    {
+      std::copy(other.begin(), other.end(), begin());
+    }
+
+    bool operator!=(Image const &other) const
+    {
+      return !std::equal(begin(), end(), other.begin());
+    }
+  };
+
+  using Kernel = void (*)(void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, uint32_t width, uint32_t height);
+  using Reference = void (*)(uint8_t *dst, uint8_t const *src, uint32_t width);
+
+  // Runs kernel and reference on the same random source, the padding and guard bytes must be left alone
+  void compare(std::string const &what, Kernel kernel, Reference reference, std::size_t srcSize, std::size_t dstSize,
+	       unsigned int offsetStep, bool inPlace)
+  {
+    for (uint32_t width = 0; width <= MAX_WIDTH; ++width)
+      for (unsigned int offset = 0; offset < MAX_OFFSET; offset += offsetStep)
+	for (std::size_t padding : {std::size_t(0), dstSize, dstSize * 5})
+	  {
+	    Image src(width * srcSize, padding, (offset * 7) % MAX_OFFSET / offsetStep * offsetStep);
+	    Image dst(width * dstSize, padding, offset);
+	    Image expected(width * dstSize, padding, offset);
+
+	    randomize(src.storage, width * 131 + offset * 7 + static_cast<uint32_t>(padding));
+	    if (inPlace)
+	      {
+		// the same rows are read and written, the reference works on its own copy of the source
+		Image image(width * srcSize, padding, offset);
+
+		image.copy(src);
+		expected.copy(src);
+		for (uint32_t y = 0; y < HEIGHT; ++y)
+		  reference(expected.data + expected.stride * y, expected.data + expected.stride * y, width);
+		kernel(image.data, image.stride, image.data, image.stride, width, HEIGHT);
+		dst.copy(image);
+	      }
+	    else
+	      {
+		for (uint32_t y = 0; y < HEIGHT; ++y)
+		  reference(expected.data + expected.stride * y, src.data + src.stride * y, width);
+		kernel(dst.data, dst.stride, src.data, src.stride, width, HEIGHT);
+	      }
+	    if (dst != expected)
+	      fail(what, width, offset, padding);
+	  }
+  }
+
+  template<pixel::Swizzle const &order>
+  void swizzleReference(uint8_t *dst, uint8_t const *src, uint32_t width)
+  {
+    for (uint32_t i = 0; i < width; ++i)
+      {
+	uint8_t pixel[4];
+
+	for (unsigned int byte = 0; byte < 4; ++byte)
+	  pixel[byte] = order[byte] == pixel::OPAQUE ? 0xff : src[i * 4 + order[byte]];
+	std::memcpy(dst + i * 4, pixel, sizeof(pixel));
+      }
+  }
+
+  template<pixel::Swizzle const &order>
+  void expandRgb888Reference(uint8_t *dst, uint8_t const *src, uint32_t width)
+  {
+    for (uint32_t i = 0; i < width; ++i)
+      for (unsigned int byte = 0; byte < 4; ++byte)
+	dst[i * 4 + byte] = order[byte] == pixel::OPAQUE ? 0xff : src[i * 3 + order[byte]];
+  }
+
+  // XRGB8888 words, stored little endian
+  void expandRgb565Reference(uint8_t *dst, uint8_t const *src, uint32_t width)
+  {
+    for (uint32_t i = 0; i < width; ++i)
+      {
+	uint32_t pixel = src[i * 2] | src[i * 2 + 1] << 8u;
+
+	dst[i * 4] = replicateBits(pixel & 0x1fu, 5);
+	dst[i * 4 + 1] = replicateBits(pixel >> 5u & 0x3fu, 6);
+	dst[i * 4 + 2] = replicateBits(pixel >> 11u, 5);
+	dst[i * 4 + 3] = 0xff;
+      }
+  }
+
+  void premultiplyReference(uint8_t *dst, uint8_t const *src, uint32_t width)
+  {
+    for (uint32_t i = 0; i < width; ++i)
+      {
+	uint8_t alpha = src[i * 4 + 3];
+
+	for (unsigned int byte = 0; byte < 3; ++byte)
+	  dst[i * 4 + byte] = multiply(src[i * 4 + byte], alpha);
+	dst[i * 4 + 3] = alpha;
+      }
+  }
+
+  void copyReference(uint8_t *dst, uint8_t const *src, uint32_t width)
+  {
+    std::memcpy(dst, src, width * 4);
+  }
+
+  // premultiplied source over the destination
+  void blendReference(uint8_t *dst, uint8_t const *src, uint32_t width)
+  {
+    for (uint32_t i = 0; i < width * 4; ++i)
+      dst[i] = static_cast<uint8_t>(std::min(255, src[i] + multiply(dst[i], 255u - src[i / 4 * 4 + 3])));
+  }
+
+  template<pixel::Swizzle const &order>
+  void swizzleKernel(void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, uint32_t width, uint32_t height)
+  {
+    pixel::swizzle(dst, dstStride, src, srcStride, width, height, order);
+  }
+
+  template<pixel::Swizzle const &order>
+  void expandRgb888Kernel(void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, uint32_t width, uint32_t height)
+  {
+    pixel::expandRgb888(dst, dstStride, src, srcStride, width, height, order);
+  }
+
+  void copyRowsKernel(void *dst, std::size_t dstStride, void const *src, std::size_t srcStride, uint32_t width, uint32_t height)
+  {
+    pixel::copyRows(dst, dstStride, src, srcStride, width * 4, height);
+  }
+
+  // the destination starts with random pixels too, unlike the other kernels
+  void checkBlend()
+  {
+    for (uint32_t width = 0; width <= MAX_WIDTH; ++width)
+      for (unsigned int offset = 0; offset < MAX_OFFSET; offset += 4)
+	for (std::size_t padding : {std::size_t(0), std::size_t(4), std::size_t(20)})
+	  {
+	    Image src(width * 4, padding, (offset * 3) % MAX_OFFSET);
+	    Image dst(width * 4, padding, offset);
+
+	    randomize(src.storage, width * 17 + offset);
+	    randomize(dst.storage, width * 29 + offset + 1);
+	    // some fully opaque and fully transparent pixels among the random ones
+	    for (uint32_t i = 0; i < width * HEIGHT; i += 5)
+	      src.data[i / width * src.stride + i % width * 4 + 3] = i % 2 ? 0xff : 0x00;
+
+	    Image expected(width * 4, padding, offset);
+
+	    expected.copy(dst);
+	    for (uint32_t y = 0; y < HEIGHT; ++y)
+	      blendReference(expected.data + expected.stride * y, src.data + src.stride * y, width);
+	    pixel::blend(dst.data, dst.stride, src.data, src.stride, width, HEIGHT);
+	    if (dst != expected)
+	      fail("blend", width, offset, padding);
+	  }
+  }
+
+  void checkFill()
+  {
+    for (uint32_t width = 0; width <= MAX_WIDTH; ++width)
+      for (unsigned int offset = 0; offset < MAX_OFFSET; offset += 4)
+	for (std::size_t padding : {std::size_t(0), std::size_t(4), std::size_t(20)})
+	  {
+	    Image dst(width * 4, padding, offset);
+	    Image expected(width * 4, padding, offset);
+	    uint32_t color = 0x80402010u + width;
+
+	    for (uint32_t y = 0; y < HEIGHT; ++y)
+	      for (uint32_t x = 0; x < width; ++x)
+		std::memcpy(expected.data + expected.stride * y + x * 4, &color, sizeof(color));
+	    pixel::fill(dst.data, dst.stride, color, width, HEIGHT);
+	    if (dst != expected)
+	      fail("fill", width, offset, padding);
+	  }
+  }
+
+  // every RGB565 value and every color and alpha pair, on top of the random rows
+  void checkExhaustive()
+  {
+    std::vector<uint8_t> src(0x10000 * 2);
+    std::vector<uint8_t> dst(0x10000 * 4);
+    std::vector<uint8_t> expected(0x10000 * 4);
+
+    for (uint32_t i = 0; i < 0x10000; ++i)
+      {
+	src[i * 2] = static_cast<uint8_t>(i);
+	src[i * 2 + 1] = static_cast<uint8_t>(i >> 8);
+      }
+    pixel::expandRgb565(dst.data(), dst.size(), src.data(), src.size(), 0x10000, 1);
+    expandRgb565Reference(expected.data(), src.data(), 0x10000);
+    if (dst != expected)
+      fail("expandRgb565 of every value", 0x10000, 0, 0);
+
+    for (uint32_t i = 0; i < 0x10000; ++i)
+      {
+	dst[i * 4] = static_cast<uint8_t>(i);
+	dst[i * 4 + 1] = static_cast<uint8_t>(~i);
+	dst[i * 4 + 2] = static_cast<uint8_t>(i * 7);
+	dst[i * 4 + 3] = static_cast<uint8_t>(i >> 8);
+      }
+    premultiplyReference(expected.data(), dst.data(), 0x10000);
+    pixel::premultiply(dst.data(), dst.size(), dst.data(), dst.size(), 0x10000, 1);
+    if (dst != expected)
+      fail("premultiply of every color and alpha", 0x10000, 0, 0);
+  }
+
+  char const *getLevel()
+  {
+    pixel::CpuFeatures const &features(pixel::getCpuFeatures());
+
+    return features.avx2 ? "avx2" : features.ssse3 ? "ssse3" : features.sse2 ? "sse2" : "scalar";
+  }
+
+  constexpr pixel::Swizzle BROADCAST_GREEN{1, 1, 1, 1};
+}
+
+int main()
+{
+  std::cout << "checking the " << getLevel() << " kernels" << std::endl;
+  compare("swizzle REVERSE_BYTES", &swizzleKernel<pixel::REVERSE_BYTES>, &swizzleReference<pixel::REVERSE_BYTES>, 4, 4, 1, false);
+  compare("swizzle SWAP_RED_BLUE", &swizzleKernel<pixel::SWAP_RED_BLUE>, &swizzleReference<pixel::SWAP_RED_BLUE>, 4, 4, 1, false);
+  compare("swizzle RGB_TO_RGBX", &swizzleKernel<pixel::RGB_TO_RGBX>, &swizzleReference<pixel::RGB_TO_RGBX>, 4, 4, 1, false);
+  compare("swizzle BROADCAST_GREEN", &swizzleKernel<BROADCAST_GREEN>, &swizzleReference<BROADCAST_GREEN>, 4, 4, 1, false);
+  compare("in place swizzle", &swizzleKernel<pixel::SWAP_RED_BLUE>, &swizzleReference<pixel::SWAP_RED_BLUE>, 4, 4, 1, true);
+  compare("expandRgb888 RGB_TO_RGBX", &expandRgb888Kernel<pixel::RGB_TO_RGBX>, &expandRgb888Reference<pixel::RGB_TO_RGBX>, 3, 4, 1, false);
+  compare("expandRgb888 RGB_TO_XRGB", &expandRgb888Kernel<pixel::RGB_TO_XRGB>, &expandRgb888Reference<pixel::RGB_TO_XRGB>, 3, 4, 1, false);
+  compare("expandRgb565", &pixel::expandRgb565, &expandRgb565Reference, 2, 4, 1, false);
+  compare("premultiply", &pixel::premultiply, &premultiplyReference, 4, 4, 1, false);
+  compare("in place premultiply", &pixel::premultiply, &premultiplyReference, 4, 4, 1, true);
+  compare("copyRows", &copyRowsKernel, &copyReference, 4, 4, 1, false);
+  compare("copy", &pixel::copy, &copyReference, 4, 4, 4, false);
+  checkFill();
+  checkBlend();
+  checkExhaustive();
+  if (failures)
+    {
+      std::cerr << failures << " mismatches" << std::endl;
+      return 1;
+    }
+  return 0;
+}